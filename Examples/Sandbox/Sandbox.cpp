@@ -11,6 +11,9 @@ import Tako.Audio;
 import Tako.Event;
 import Tako.Font;
 import Tako.Serialization;
+#ifdef TAKO_IMGUI
+import Tako.ImGui;
+#endif
 
 static tako::Texture tree;
 static tako::Texture tileset;
@@ -190,6 +193,7 @@ void Update(const tako::GameStageData stageData, tako::Input* input, float dt)
 	ImGui::Text("Heyo!");
 	ImGui::End();
 	ImGui::ShowDemoWindow();
+	tako::ShowAllocationStatsWindow();
 	static tako::Serialization::TestComponent comp = {};
 
 	ImGui::Begin("Component");
@@ -6,6 +6,17 @@
 #include <unordered_map>
 #include <mutex>
 #include <atomic>
+#include <chrono>
+#include <string>
+#include <system_error>
+#include <algorithm>
+#include <cstring>
+#ifdef TAKO_LINUX
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
 
 import Tako.VFS;
 
@@ -20,8 +31,10 @@ namespace tako
 	class FileWatcher
 	{
 	public:
-		FileWatcher(VFS* vfs)
+		FileWatcher(VFS* vfs) : m_vfs(vfs)
 		{
+			// Changes reach the index through UpdateIndex, so the VFS can stop probing on a miss
+			m_vfs->AttachWatcher();
 			m_thread = std::thread(&FileWatcher::WatchFolder, this, vfs);
 		}
 
@@ -29,6 +42,7 @@ namespace tako
 		{
 			m_running = false;
 			m_thread.join();
+			m_vfs->DetachWatcher();
 		}
 
 		std::vector<FileChanged> Poll()
@@ -45,22 +59,66 @@ namespace tako
 		}
 
 	private:
+		using Clock = std::chrono::steady_clock;
+		// Editors save in several writes (or write a temp file and rename it), a path has to be quiet this long before it's reported
+		static constexpr auto DebounceTime = std::chrono::milliseconds(100);
+		static constexpr auto PollInterval = std::chrono::milliseconds(500);
+
+		VFS* m_vfs;
 		std::atomic<bool> m_running = true;
 		std::atomic<bool> m_changed = true;
 		std::thread m_thread;
 		std::mutex m_mutex;
 		std::vector<FileChanged> m_changes;
 
+		struct WatchedFile
+		{
+			std::filesystem::file_time_type lastWrite;
+			std::filesystem::path mountPath;
+			std::string virtualPath;
+			bool seen;
+		};
+
+		struct PendingChange
+		{
+			std::filesystem::path mountPath;
+			std::string virtualPath;
+			Clock::time_point deadline;
+		};
+
 		void WatchFolder(VFS* vfs)
 		{
-			std::unordered_map<std::filesystem::path, std::filesystem::file_time_type> paths;
+#ifdef TAKO_LINUX
+			if (WatchInotify(vfs))
+			{
+				return;
+			}
+			LOG_WARN("Falling back to polling for file changes");
+#endif
+			WatchPolling(vfs);
+		}
+
+		void PushChanges(std::vector<FileChanged>& changes)
+		{
+			if (changes.size() > 0)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_changed = true;
+				m_changes.insert(m_changes.end(), changes.begin(), changes.end());
+			}
+		}
+
+		void WatchPolling(VFS* vfs)
+		{
+			std::unordered_map<std::filesystem::path, WatchedFile> paths;
 
 			for (auto& path : vfs->GetMountPaths())
 			{
-				for (auto &file : std::filesystem::recursive_directory_iterator(path))
+				ScanMount(path, [&](const std::filesystem::directory_entry& file, const std::string& virtualPath)
 				{
-					paths[file.path()] = std::filesystem::last_write_time(file);
-				}
+					std::error_code error;
+					paths[file.path()] = { file.last_write_time(error), path, virtualPath, true };
+				});
 			}
 
 			while (m_running)
@@ -69,45 +127,297 @@ namespace tako
 				{
 					std::vector<FileChanged> changes;
 
+					for (auto& [_, watched] : paths)
+					{
+						watched.seen = false;
+					}
 					for (auto& path : vfs->GetMountPaths())
 					{
-						for (auto &file : std::filesystem::recursive_directory_iterator(path))
+						ScanMount(path, [&](const std::filesystem::directory_entry& file, const std::string& virtualPath)
 						{
-							if (!std::filesystem::exists(file.path())) {
-								continue;
+							std::error_code error;
+							auto newWrite = file.last_write_time(error);
+							if (error)
+							{
+								return;
 							}
-							auto newWrite = std::filesystem::last_write_time(file);
 
 							auto found = paths.find(file.path());
 							if (found != paths.end())
 							{
-								auto lastWrite = found->second;
+								found->second.seen = true;
+								auto lastWrite = found->second.lastWrite;
 								if (lastWrite != newWrite) {
 									//LOG("File changed! {}", file.path());
 									changes.push_back({file.path(), path});
-									found->second = newWrite;
-
+									found->second.lastWrite = newWrite;
+									vfs->UpdateIndex(virtualPath);
 								}
 							}
 							else
 							{
 								//LOG("New file! {}", file.path());
-								paths[file.path()] = newWrite;
+								paths[file.path()] = { newWrite, path, virtualPath, true };
 								changes.push_back({file.path(), path});
+								vfs->UpdateIndex(virtualPath);
 							}
+						});
+					}
+
+					// Deleted files only need to leave the index, there is nothing to reload
+					for (auto it = paths.begin(); it != paths.end();)
+					{
+						if (it->second.seen)
+						{
+							++it;
+							continue;
 						}
+						vfs->UpdateIndex(it->second.virtualPath);
+						it = paths.erase(it);
 					}
 
-					if (changes.size() > 0)
+					PushChanges(changes);
+				}
+
+				std::this_thread::sleep_for(PollInterval);
+			}
+		}
+
+#ifdef TAKO_LINUX
+		struct WatchedDirectory
+		{
+			std::filesystem::path path;
+			std::filesystem::path mountPath;
+		};
+
+		class Inotify
+		{
+		public:
+			int fd = -1;
+			std::unordered_map<int, WatchedDirectory> directories;
+
+			~Inotify()
+			{
+				if (fd >= 0)
+				{
+					close(fd);
+				}
+			}
+
+			// Watches directory and everything below it, files already inside are passed to onFile.
+			// Fails when the watch limit (fs.inotify.max_user_watches) is reached.
+			template<typename Cb>
+			bool AddTree(const std::filesystem::path& directory, const std::filesystem::path& mountPath, Cb&& onFile)
+			{
+				if (!AddDirectory(directory, mountPath))
+				{
+					return false;
+				}
+				std::error_code error;
+				std::filesystem::recursive_directory_iterator it(directory, error);
+				for (; !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+				{
+					if (it->is_directory(error))
 					{
-						std::lock_guard<std::mutex> lock(m_mutex);
-						m_changed = true;
-						m_changes.insert(m_changes.end(), changes.begin(), changes.end());
+						if (!AddDirectory(it->path(), mountPath))
+						{
+							return false;
+						}
+					}
+					else if (it->is_regular_file(error))
+					{
+						onFile(it->path());
 					}
 				}
+				return true;
+			}
 
-				std::this_thread::sleep_for(std::chrono::milliseconds(500));
+			// Stops watching directory and everything below it, e.g. after it was moved out of the mount
+			void RemoveTree(const std::filesystem::path& directory)
+			{
+				for (auto it = directories.begin(); it != directories.end();)
+				{
+					auto relative = it->second.path.lexically_relative(directory);
+					if (!relative.empty() && *relative.begin() != "..")
+					{
+						inotify_rm_watch(fd, it->first);
+						it = directories.erase(it);
+					}
+					else
+					{
+						++it;
+					}
+				}
 			}
+		private:
+			bool AddDirectory(const std::filesystem::path& directory, const std::filesystem::path& mountPath)
+			{
+				constexpr U32 mask = IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR;
+				int wd = inotify_add_watch(fd, directory.c_str(), mask);
+				if (wd < 0)
+				{
+					// The directory can be gone again before we got to it
+					if (errno == ENOENT || errno == ENOTDIR)
+					{
+						return true;
+					}
+					LOG_ERR("Could not watch {}: {}", directory.string(), std::strerror(errno));
+					return false;
+				}
+				directories[wd] = { directory, mountPath };
+				return true;
+			}
+		};
+
+		// Events are collected per path and only reported once the path was quiet for DebounceTime,
+		// so a burst of writes or a save via rename turns into a single change
+		bool WatchInotify(VFS* vfs)
+		{
+			Inotify inotify;
+			inotify.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (inotify.fd < 0)
+			{
+				LOG_ERR("Could not initialize inotify: {}", std::strerror(errno));
+				return false;
+			}
+
+			std::unordered_map<std::filesystem::path, PendingChange> pending;
+			auto addPending = [&](const std::filesystem::path& path, const std::filesystem::path& mountPath)
+			{
+				auto& change = pending[path];
+				change.mountPath = mountPath;
+				change.virtualPath = "/" + path.lexically_relative(mountPath).generic_string();
+				change.deadline = Clock::now() + DebounceTime;
+			};
+
+			size_t fileCount = 0;
+			for (auto& mountPath : vfs->GetMountPaths())
+			{
+				if (!inotify.AddTree(mountPath, mountPath, [&](const std::filesystem::path&) { fileCount++; }))
+				{
+					return false;
+				}
+			}
+			LOG("Watching {} directories ({} files) with inotify", inotify.directories.size(), fileCount);
+
+			alignas(inotify_event) char buffer[64 * 1024];
+			while (m_running)
+			{
+				// Wake up for the next debounce deadline, or regularly to notice shutdown
+				auto timeout = std::chrono::milliseconds(PollInterval);
+				auto now = Clock::now();
+				for (auto& [_, change] : pending)
+				{
+					timeout = std::min(timeout, std::chrono::ceil<std::chrono::milliseconds>(std::max(change.deadline - now, Clock::duration::zero())));
+				}
+				pollfd pfd = { inotify.fd, POLLIN, 0 };
+				int ready = poll(&pfd, 1, static_cast<int>(timeout.count()));
+				if (ready < 0 && errno != EINTR)
+				{
+					LOG_ERR("Polling inotify failed: {}", std::strerror(errno));
+					PushAllPending(vfs, pending);
+					return false;
+				}
+
+				while (ready > 0)
+				{
+					ssize_t length = read(inotify.fd, buffer, sizeof(buffer));
+					if (length <= 0)
+					{
+						break;
+					}
+					for (char* ptr = buffer; ptr < buffer + length; ptr += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(ptr)->len)
+					{
+						auto event = reinterpret_cast<const inotify_event*>(ptr);
+						if (event->mask & IN_Q_OVERFLOW)
+						{
+							// Events were dropped, everything could have changed
+							LOG_WARN("inotify queue overflowed, rescanning mount paths");
+							for (auto& mountPath : vfs->GetMountPaths())
+							{
+								ScanMount(mountPath, [&](const std::filesystem::directory_entry& file, const std::string&)
+								{
+									addPending(file.path(), mountPath);
+								});
+							}
+							continue;
+						}
+						auto found = inotify.directories.find(event->wd);
+						if (found == inotify.directories.end())
+						{
+							continue;
+						}
+						if (event->mask & IN_IGNORED)
+						{
+							inotify.directories.erase(found);
+							continue;
+						}
+						if (event->len == 0)
+						{
+							continue;
+						}
+						auto directory = found->second;
+						auto path = directory.path / event->name;
+						if (event->mask & IN_ISDIR)
+						{
+							// A new (or moved in) directory needs its own watch, files could already be inside
+							if (event->mask & (IN_CREATE | IN_MOVED_TO))
+							{
+								if (!inotify.AddTree(path, directory.mountPath, [&](const std::filesystem::path& file) { addPending(file, directory.mountPath); }))
+								{
+									PushAllPending(vfs, pending);
+									return false;
+								}
+							}
+							// Moving a directory away reports nothing for the files inside, so everything indexed below it is checked
+							else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+							{
+								inotify.RemoveTree(path);
+								auto virtualDirectory = "/" + path.lexically_relative(directory.mountPath).generic_string();
+								for (auto& virtualPath : vfs->GetIndexedFiles(virtualDirectory))
+								{
+									addPending(directory.mountPath / virtualPath.substr(1), directory.mountPath);
+								}
+							}
+							continue;
+						}
+						addPending(path, directory.mountPath);
+					}
+				}
+
+				FlushPending(vfs, pending, Clock::now());
+			}
+			return true;
+		}
+
+		// Reports everything that settled before the deadline
+		void FlushPending(VFS* vfs, std::unordered_map<std::filesystem::path, PendingChange>& pending, Clock::time_point now)
+		{
+			std::vector<FileChanged> changes;
+			for (auto it = pending.begin(); it != pending.end();)
+			{
+				if (it->second.deadline > now)
+				{
+					++it;
+					continue;
+				}
+				vfs->UpdateIndex(it->second.virtualPath);
+				// Deleted files only need to leave the index, there is nothing to reload
+				std::error_code error;
+				if (std::filesystem::is_regular_file(it->first, error))
+				{
+					changes.push_back({ it->first, it->second.mountPath });
+				}
+				it = pending.erase(it);
+			}
+			PushChanges(changes);
+		}
+
+		// Before falling back to polling, which only sees changes made after it started
+		void PushAllPending(VFS* vfs, std::unordered_map<std::filesystem::path, PendingChange>& pending)
+		{
+			FlushPending(vfs, pending, Clock::time_point::max());
 		}
+#endif
 	};
 }
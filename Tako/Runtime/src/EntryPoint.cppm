@@ -39,8 +39,10 @@ import Tako.Application;
 import Tako.VFS;
 import Tako.Resources;
 import Tako.JobSystem;
+import Tako.Trace;
 import Tako.RmlUi;
-import Tako.Allocators.CachePoolAllocator;
+import Tako.Allocators.LinearAllocator;
+import Tako.Allocators.FrameArenaRing;
 #ifdef TAKO_IMGUI
 import Tako.ImGui;
 #endif
@@ -60,8 +62,8 @@ namespace tako
 		GameConfig& config;
 		JobSystem& jobSys;
 		std::atomic<bool>& keepRunning;
-		//Allocators::PoolAllocator frameDataPool;
-		Allocators::CachePoolAllocator frameDataAllocator;
+		// Only acquired and retired between the stages of a frame, so it needs no lock
+		Allocators::FrameArenaRing frameArenas;
 #ifdef TAKO_EDITOR
 		tako::FileWatcher& watcher;
 #endif
@@ -70,25 +72,33 @@ namespace tako
 		emscripten::ProxyingQueue proxyQueue;
 #endif
 
-		std::atomic_flag frameDataPoolLock = ATOMIC_FLAG_INIT;
 		std::atomic<int> frame = 0;
-		int openFrames = 1;
-		std::atomic_flag frameCounterLock = ATOMIC_FLAG_INIT;
+	};
+
+	// One for the frame being updated, one for the frame being drawn
+	constexpr size_t MaxFramesInFlight = 2;
 
+	struct FrameInFlight
+	{
+		Allocators::LinearAllocator* arena = nullptr;
+		void* frameData = nullptr;
+		size_t frameDataSize = 0;
 	};
 
-	Task<> Tick(void* p)
+	float NextDeltaTime()
 	{
-		//LOG("Tick Start");
 		static tako::Timer timer;
-		constexpr auto maxFramesConcurrent = 2;
 		float dt = timer.GetDeltaTime();
-		TickStruct* data = reinterpret_cast<TickStruct*>(p);
-		auto thisFrame = ++data->frame;
 		static std::atomic<float> fps = 1;
 		fps = 0.01f * 1/dt + 0.99f * fps;
-		//LOG("frame {}: fps: {}", thisFrame, 1/dt);
+		//LOG("fps: {}", 1/dt);
+		return dt;
+	}
+
+	void ProcessFileChanges(TickStruct* data)
+	{
 #ifdef TAKO_EDITOR
+		std::vector<std::string> changed;
 		for (auto& change: data->watcher.Poll())
 		{
 			auto path = std::filesystem::relative(change.path, change.mountPath).string();
@@ -103,149 +113,276 @@ namespace tako
 			path = "/" + path;
 			LOG("Filechange detected {}", path);
 			//TODO: Check if change is the highest priority mount path
-			data->resources.Reload(path);
+			changed.push_back(std::move(path));
+		}
+		if (changed.size() > 0)
+		{
+			// Decoded on the workers, applied together by ApplyAsyncLoads in one of the next frames
+			data->resources.ReloadBatch(changed);
 		}
 #endif
+	}
 
-		size_t frameDataSize;
-		auto allocateFrameDataTask = JobSystem::Taskify([&]()
+	FrameInFlight AllocateFrameData(TickStruct* data)
+	{
+		if (data->config.CheckFrameDataSizeChange)
 		{
-			if (data->config.CheckFrameDataSizeChange)
-			{
-				data->config.CheckFrameDataSizeChange(data->gameData, data->config.frameDataSize);
-			}
-			frameDataSize = data->config.frameDataSize;
-			/*
-			while (data->frameDataPoolLock.test_and_set(std::memory_order_acquire));
-			void* frameData = data->frameDataAllocator.Allocate(frameDataSize);
-			data->frameDataPoolLock.clear(std::memory_order_release);
-			*/
-			return malloc(frameDataSize);
-		});
+			data->config.CheckFrameDataSizeChange(data->gameData, data->config.frameDataSize);
+		}
+		FrameInFlight frame;
+		frame.frameDataSize = data->config.frameDataSize;
+		// Frame data sits at the start of the arena, the scratch memory behind it
+		frame.arena = data->frameArenas.Acquire(frame.frameDataSize + data->config.frameScratchSize);
+		frame.frameData = frame.arena->Allocate(frame.frameDataSize);
+		return frame;
+	}
 
+	void ReleaseFrameData(TickStruct* data, FrameInFlight& frame)
+	{
+		if (frame.arena)
+		{
+			data->frameArenas.Retire(frame.arena);
+			frame = {};
+		}
+	}
 
-#ifdef TAKO_GLFW
-		JobSystem::ScheduleNextTaskOnMain();
-#endif
-		auto inputPollTask = JobSystem::Taskify([&]()
+	GameStageData GetStageData(TickStruct* data, const FrameInFlight& frame)
+	{
+		return
 		{
-			data->window.Poll();
-			data->input.Update();
+			data->gameData,
+			frame.frameData,
+			frame.frameDataSize,
+			frame.arena
+		};
+	}
+
+	void BeginUIFrame(TickStruct* data)
+	{
 #ifdef TAKO_IMGUI
-			switch (data->context.GetAPI())
-			{
-				#ifdef TAKO_OPENGL
-				case GraphicsAPI::OpenGL:
-					ImGui_ImplOpenGL3_Init();
-					break;
-				#endif
-				#ifdef TAKO_WEBGPU
-				case GraphicsAPI::WebGPU:
-					ImGui_ImplWGPU_NewFrame();
-					break;
-				#endif
-			}
+		switch (data->context.GetAPI())
+		{
+			#ifdef TAKO_OPENGL
+			case GraphicsAPI::OpenGL:
+				ImGui_ImplOpenGL3_Init();
+				break;
+			#endif
+			#ifdef TAKO_WEBGPU
+			case GraphicsAPI::WebGPU:
+				ImGui_ImplWGPU_NewFrame();
+				break;
+			#endif
+		}
 
 #if defined(TAKO_GLFW)
-			ImGui_ImplGlfw_NewFrame();
+		ImGui_ImplGlfw_NewFrame();
 #elif defined(TAKO_WIN32)
-			ImGui_ImplWin32_NewFrame();
+		ImGui_ImplWin32_NewFrame();
 #endif
-			ImGui::NewFrame();
+		ImGui::NewFrame();
 #endif
+	}
+
+	void PollInput(TickStruct* data)
+	{
+		data->window.Poll();
+		data->input.Update();
+	}
+
+	void UpdateFrame(TickStruct* data, const GameStageData& stageData, float dt)
+	{
+		Trace::Scope traceScope("Update");
+		if (data->config.Update)
+		{
+			data->config.Update(stageData, &data->input, dt);
+		}
+	}
+
+	void DrawFrame(TickStruct* data, const GameStageData& stageData)
+	{
+		Trace::Scope traceScope("Draw");
+		data->context.Begin();
+		if (data->config.Draw)
+		{
+			data->config.Draw(stageData);
+		}
+		data->ui.Draw();
+		#ifdef TAKO_IMGUI
+		ImGui::Render();
+		switch (data->context.GetAPI())
+		{
+			#ifdef TAKO_OPENGL
+			case GraphicsAPI::OpenGL:
+				ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+				break;
+			#endif
+			#ifdef TAKO_WEBGPU
+			case GraphicsAPI::WebGPU:
+				WebGPUContext* wcontext = reinterpret_cast<WebGPUContext*>(&data->context);
+				ImGui_ImplWGPU_RenderDrawData(ImGui::GetDrawData(), wcontext->GetRenderPass());
+				break;
+			#endif
+		}
+		#endif
+		data->context.End();
+
+		#ifdef TAKO_IMGUI
+		if (ImGui::GetIO().ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
+		{
+			ImGui::UpdatePlatformWindows();
+			ImGui::RenderPlatformWindowsDefault();
+		}
+		#endif
+		data->context.Present();
+	}
+
+	// The main task isn't resumed once the job system stops, so anything left to do on quit happens here
+	void StopGameLoop(TickStruct* data)
+	{
+		data->keepRunning = false;
+		if constexpr (Trace::Enabled)
+		{
+			Trace::WriteChromeTrace("trace.json");
+		}
+		data->jobSys.Stop();
+	}
+
+	Task<> Tick(void* p)
+	{
+		//LOG("Tick Start");
+		float dt = NextDeltaTime();
+		TickStruct* data = reinterpret_cast<TickStruct*>(p);
+		++data->frame;
+		ProcessFileChanges(data);
+
+		JobSystem::SetNextTaskName("AllocateFrameData");
+		auto allocateFrameDataTask = JobSystem::Taskify([&]()
+		{
+			return AllocateFrameData(data);
 		});
 
-		co_await inputPollTask;
-		void* frameData = co_await allocateFrameDataTask;
+
+#ifdef TAKO_GLFW
+		JobSystem::ScheduleNextTaskOnMain();
+#endif
+		JobSystem::SetNextTaskName("InputPoll");
+		auto inputPollTask = JobSystem::Taskify([&]()
+		{
+			PollInput(data);
+			data->resources.ApplyAsyncLoads();
+			BeginUIFrame(data);
+		});
+
+		co_await WhenAll(inputPollTask, allocateFrameDataTask);
+		FrameInFlight frame = allocateFrameDataTask.GetResult();
+		GameStageData stageData = GetStageData(data, frame);
 
 		if (data->config.Update)
 		{
-			GameStageData stageData
-			{
-				data->gameData,
-				frameData,
-				frameDataSize
-			};
-			if (data->config.Update)
-			{
-				data->config.Update(stageData, &data->input, dt);
-			}
+			UpdateFrame(data, stageData, dt);
 			data->ui.Update();
 		}
 
 		if (data->window.ShouldExit() || !data->keepRunning)
 		{
-			data->keepRunning = false;
-			data->jobSys.Stop();
+			ReleaseFrameData(data, frame);
+			StopGameLoop(data);
 			co_return;
 		}
-		//data->jobSys.Schedule([=]()
-		#ifdef TAKO_EMSCRIPTEN
-		//data->proxyQueue.proxySync(data->mainThread, [=]()
-		#endif
+
+		DrawFrame(data, stageData);
+		//LOG("Tick End");
+
+		ReleaseFrameData(data, frame);
+	}
+
+	// Draw stage of PipelinedTick, UI is updated here since it belongs to the frame being drawn
+	void DrawStage(TickStruct* data, const FrameInFlight& frame)
+	{
+		BeginUIFrame(data);
+		data->ui.Update();
+		DrawFrame(data, GetStageData(data, frame));
+	}
+
+	// Update of this frame runs on the workers while the main thread draws the previous one.
+	// Input is polled while neither stage runs, UI (ImGui and RmlUi) belongs to the draw stage.
+	Task<> PipelinedTick(TickStruct* data, FrameInFlight& previous)
+	{
+		float dt = NextDeltaTime();
+		++data->frame;
+		ProcessFileChanges(data);
+
+		JobSystem::SetNextTaskName("AllocateFrameData");
+		auto allocateFrameDataTask = JobSystem::Taskify([&]()
+		{
+			return AllocateFrameData(data);
+		});
+
+#ifdef TAKO_GLFW
+		JobSystem::ScheduleNextTaskOnMain();
+#endif
+		JobSystem::SetNextTaskName("InputPoll");
+		auto inputPollTask = JobSystem::Taskify([&]()
+		{
+			PollInput(data);
+			// Between draws, so swapped in textures don't change in the middle of a frame
+			data->resources.ApplyAsyncLoads();
+		});
+
+		co_await WhenAll(inputPollTask, allocateFrameDataTask);
+		FrameInFlight current = allocateFrameDataTask.GetResult();
+
+		if (data->window.ShouldExit() || !data->keepRunning)
 		{
-			data->context.Begin();
-			if (data->config.Draw)
+			ReleaseFrameData(data, current);
+			// The last simulated frame is still shown before stopping
+			if (previous.arena)
 			{
-				GameStageData stageData
+#ifdef TAKO_GLFW
+				JobSystem::ScheduleNextTaskOnMain();
+#endif
+				JobSystem::SetNextTaskName("Draw");
+				auto drawTask = JobSystem::Taskify([&]()
 				{
-					data->gameData,
-					frameData,
-					frameDataSize
-				};
-				data->config.Draw(stageData);
-			}
-			data->ui.Draw();
-			#ifdef TAKO_IMGUI
-			ImGui::Render();
-			switch (data->context.GetAPI())
-			{
-				#ifdef TAKO_OPENGL
-				case GraphicsAPI::OpenGL:
-					ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-					break;
-				#endif
-				#ifdef TAKO_WEBGPU
-				case GraphicsAPI::WebGPU:
-					WebGPUContext* wcontext = reinterpret_cast<WebGPUContext*>(&data->context);
-					ImGui_ImplWGPU_RenderDrawData(ImGui::GetDrawData(), wcontext->GetRenderPass());
-					break;
-				#endif
+					DrawStage(data, previous);
+				});
+				co_await drawTask;
 			}
-			#endif
-			data->context.End();
+			ReleaseFrameData(data, previous);
+			StopGameLoop(data);
+			co_return;
+		}
+
+		JobSystem::SetNextTaskName("Update");
+		auto updateTask = JobSystem::Taskify([&]()
+		{
+			UpdateFrame(data, GetStageData(data, current), dt);
+		});
 
-			#ifdef TAKO_IMGUI
-			if (ImGui::GetIO().ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
+#ifdef TAKO_GLFW
+		JobSystem::ScheduleNextTaskOnMain();
+#endif
+		JobSystem::SetNextTaskName("Draw");
+		auto drawTask = JobSystem::Taskify([&]()
+		{
+			// Nothing was simulated yet on the first frame
+			if (!previous.arena)
 			{
-				ImGui::UpdatePlatformWindows();
-				ImGui::RenderPlatformWindowsDefault();
+				return;
 			}
-			#endif
-			data->context.Present();
-			//LOG("Tick End");
-		#ifdef TAKO_EMSCRIPTEN
-		}
-		#else
-		}
-		#endif
+			DrawStage(data, previous);
+		});
 
-		#ifndef EMSCRIPTEN
-			//data->jobSys.ScheduleDetached(std::bind(Tick, p));
-		#endif
+		co_await WhenAll(updateTask, drawTask);
 
-		/*
-		while (data->frameDataPoolLock.test_and_set(std::memory_order_acquire));
-		data->frameDataAllocator.Deallocate(frameData, frameDataSize);
-		data->frameDataPoolLock.clear(std::memory_order_release);
-		*/
-		free(frameData);
+		ReleaseFrameData(data, previous);
+		previous = current;
 	}
 
 	void EmscriptenDelayed(void* p)
 	{
 		TickStruct* data = reinterpret_cast<TickStruct*>(p);
-		data->jobSys.Init();
+		data->jobSys.Init(data->config.jobSystem);
 		if (data->config.Setup)
 		{
 			//data->jobSys.RunJob([=]()
@@ -262,7 +399,7 @@ namespace tako
 		//data->jobSys.RunJob(std::bind(Tick, p));
 	}
 
-	Task<int> MainLoop(JobSystem& jobSys);
+	Task<int> MainLoop(JobSystem& jobSys, GameConfig& config);
 
 	export int RunGameLoop(int argc, char* argv[])
 	{
@@ -270,17 +407,18 @@ namespace tako
 		Application::argc = argc;
 		Application::argv = argv;
 
+		GameConfig config = {};
+		tako::InitTakoConfig(config);
+
 		JobSystem jobSys;
 #ifndef EMSCRIPTEN
-		jobSys.Init();
+		jobSys.Init(config.jobSystem);
 #endif
-		return jobSys.Start(MainLoop(jobSys));
+		return jobSys.Start(MainLoop(jobSys, config));
 	}
 
-	Task<int> MainLoop(JobSystem& jobSys)
+	Task<int> MainLoop(JobSystem& jobSys, GameConfig& config)
 	{
-		GameConfig config = {};
-		tako::InitTakoConfig(config);
 
 		Audio audio;
 		auto audioTask = JobSystem::Taskify([&]()
@@ -429,8 +567,7 @@ namespace tako
 			config,
 			jobSys,
 			keepRunning,
-			//{ framePoolData, framePoolSize, config.frameDataSize },
-			{},
+			{ MaxFramesInFlight },
 #ifdef TAKO_EDITOR
 			watcher
 #endif
@@ -445,10 +582,24 @@ namespace tako
 #ifndef TAKO_EMSCRIPTEN
 		//jobSys.Schedule(std::bind(Tick, &data));
 		//jobSys.JoinAsWorker();
-		while (keepRunning)
+		if (config.pipelinedFrames)
+		{
+			FrameInFlight inFlight;
+			while (keepRunning)
+			{
+				JobSystem::SetNextTaskName("Tick");
+				auto tick = PipelinedTick(&data, inFlight);
+				co_await tick;
+			}
+		}
+		else
 		{
-			auto tick = Tick(&data);
-			co_await tick;
+			while (keepRunning)
+			{
+				JobSystem::SetNextTaskName("Tick");
+				auto tick = Tick(&data);
+				co_await tick;
+			}
 		}
 #else
 		emscripten_push_main_loop_blocker(EmscriptenDelayed, &data);
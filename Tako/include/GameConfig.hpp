@@ -15,6 +15,8 @@ import Tako.NumberTypes;
 import Tako.VFS;
 import Tako.Resources;
 import Tako.GraphicsContext;
+import Tako.JobSystem;
+import Tako.Allocators.LinearAllocator;
 
 namespace tako
 {
@@ -27,11 +29,14 @@ namespace tako
 		RmlUi* ui;
 	};
 
+	// With pipelinedFrames, Draw may only read frameData and gameData that Update leaves untouched
 	struct GameStageData
 	{
 		void* gameData;
 		void* frameData;
 		size_t frameDataSize;
+		// Scratch memory for the stage, reset once the frame is drawn
+		Allocators::LinearAllocator* frameAllocator;
 	};
 
 	struct GameConfig
@@ -42,7 +47,12 @@ namespace tako
 		void (*Draw)(const GameStageData stageData);
 		size_t gameDataSize;
 		size_t frameDataSize;
+		// Bump allocated scratch memory per frame, on top of frameDataSize
+		size_t frameScratchSize = 64 * 1024;
 		GraphicsAPI graphicsAPI = GraphicsAPI::Default;
 		bool initAudioDelayed;
+		// Draw frame N while Update runs on frame N+1
+		bool pipelinedFrames = false;
+		JobSystemConfig jobSystem;
 	};
 }
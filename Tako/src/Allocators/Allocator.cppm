@@ -1,5 +1,10 @@
 module;
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#ifdef TAKO_WINDOWS
+#include <malloc.h>
+#endif
 export module Tako.Allocators.Allocator;
 
 namespace tako
@@ -7,8 +12,44 @@ namespace tako
 	export class Allocator
 	{
 	public:
+		// What the plain Allocate is expected to satisfy where the allocator can
+		static constexpr size_t DefaultAlignment = alignof(std::max_align_t);
+
 		virtual ~Allocator() {};
 		virtual void* Allocate(size_t size) = 0;
 		virtual void Deallocate(void* p, size_t size) = 0;
+		// alignment has to be a power of two, pass the same size and alignment to Deallocate
+		virtual void* Allocate(size_t size, size_t alignment) = 0;
+		virtual void Deallocate(void* p, size_t size, size_t alignment) = 0;
 	};
+
+	export constexpr size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	export inline bool IsAligned(const void* p, size_t alignment)
+	{
+		return (reinterpret_cast<uintptr_t>(p) & (alignment - 1)) == 0;
+	}
+
+	// Memory has to be released with AlignedFree
+	export inline void* AlignedAlloc(size_t size, size_t alignment)
+	{
+		alignment = alignment < alignof(std::max_align_t) ? alignof(std::max_align_t) : alignment;
+#ifdef TAKO_WINDOWS
+		return _aligned_malloc(size, alignment);
+#else
+		return std::aligned_alloc(alignment, AlignUp(size, alignment));
+#endif
+	}
+
+	export inline void AlignedFree(void* p)
+	{
+#ifdef TAKO_WINDOWS
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
 }
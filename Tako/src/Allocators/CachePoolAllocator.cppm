@@ -22,27 +22,32 @@ namespace tako::Allocators
 			{
 				Node* node = reinterpret_cast<Node*>(m_freeList);
 				m_freeList = node->next;
-				free(node);
+				AlignedFree(node);
 			}
 		}
 
 
 		virtual void* Allocate(size_t size) override
+		{
+			return Allocate(size, DefaultAlignment);
+		}
+
+		virtual void* Allocate(size_t size, size_t alignment) override
 		{
 			ASSERT(size >= sizeof(Node));
 			while (m_freeList != nullptr)
 			{
 				Node* node = reinterpret_cast<Node*>(m_freeList);
 				m_freeList = node->next;
-				if (node->size == size)
+				if (node->size == size && IsAligned(node, alignment))
 				{
 					return node;
 				}
 
-				free(node);
+				AlignedFree(node);
 			}
 
-			return malloc(size);
+			return AlignedAlloc(size, alignment);
 		}
 
 		virtual void Deallocate(void* p, size_t size) override
@@ -53,6 +58,11 @@ namespace tako::Allocators
 
 			m_freeList = node;
 		}
+
+		virtual void Deallocate(void* p, size_t size, size_t alignment) override
+		{
+			Deallocate(p, size);
+		}
 	private:
 		void* m_freeList = nullptr;
 	};
@@ -0,0 +1,101 @@
+module;
+#include "Utility.hpp"
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+export module Tako.Allocators.FrameArenaRing;
+
+import Tako.Allocators.LinearAllocator;
+import Tako.Allocators.TrackingAllocator;
+
+namespace tako::Allocators
+{
+	// Linear arenas handed out to frames in order, reset once the frame retires.
+	// Acquire and Retire have to be called from one thread at a time,
+	// the arenas themselves aren't thread safe either.
+	// Allocations aren't tracked one by one, each retired frame reports its high-water mark to the "Frame" tag.
+	export class FrameArenaRing
+	{
+	public:
+		FrameArenaRing(size_t frameCount) : m_tag("Frame")
+		{
+			ASSERT(frameCount > 0);
+			m_slots.resize(frameCount);
+		}
+
+		~FrameArenaRing()
+		{
+			for (auto& slot : m_slots)
+			{
+				free(slot.memory);
+			}
+		}
+
+		FrameArenaRing(const FrameArenaRing&) = delete;
+		FrameArenaRing& operator=(const FrameArenaRing&) = delete;
+
+		// Returns an empty arena of at least capacity bytes for the next frame
+		LinearAllocator* Acquire(size_t capacity)
+		{
+			auto& slot = m_slots[m_next];
+			ASSERT(!slot.inUse);
+			m_next = (m_next + 1) % m_slots.size();
+
+			if (slot.capacity < capacity)
+			{
+				free(slot.memory);
+				slot.memory = malloc(capacity);
+				ASSERT(slot.memory);
+				slot.capacity = capacity;
+				slot.arena = LinearAllocator(slot.memory, slot.capacity);
+			}
+			slot.arena.Reset();
+			slot.inUse = true;
+			return &slot.arena;
+		}
+
+		void Retire(LinearAllocator* arena)
+		{
+			for (auto& slot : m_slots)
+			{
+				if (&slot.arena == arena)
+				{
+					ASSERT(slot.inUse);
+					m_tag.OnHighWaterMark(slot.arena.GetHighWaterMark());
+					slot.arena.Reset();
+					slot.inUse = false;
+					return;
+				}
+			}
+			ASSERT(false);
+		}
+
+		size_t GetFrameCount() const
+		{
+			return m_slots.size();
+		}
+
+		// Most memory a single frame used so far, to size frameScratchSize
+		size_t GetHighWaterMark() const
+		{
+			size_t mark = 0;
+			for (auto& slot : m_slots)
+			{
+				mark = std::max(mark, slot.arena.GetHighWaterMark());
+			}
+			return mark;
+		}
+	private:
+		struct Slot
+		{
+			void* memory = nullptr;
+			size_t capacity = 0;
+			LinearAllocator arena{ nullptr, 0 };
+			bool inUse = false;
+		};
+
+		AllocationTag m_tag;
+		std::vector<Slot> m_slots;
+		size_t m_next = 0;
+	};
+}
@@ -1,6 +1,8 @@
 module;
 #include "NumberTypes.hpp"
 #include <cstddef>
+#include <cstdint>
+#include <algorithm>
 export module Tako.Allocators.FreeListAllocator;
 
 import Tako.Allocators.Allocator;
@@ -26,49 +28,43 @@ namespace tako::Allocators
 
 		virtual void* Allocate(size_t size) override
 		{
+			return Allocate(size, alignof(Node));
+		}
+
+		// First fit, the padding in front of the aligned address stays on the free list
+		virtual void* Allocate(size_t size, size_t alignment) override
+		{
+			size = GetBlockSize(size);
+			alignment = std::max(alignment, alignof(Node));
 			Node* cur = m_head;
 			Node* prev = nullptr;
-			while (cur != nullptr && cur->size != size && (cur->size + sizeof(Node)) < size)
-			{
-				prev = cur;
-				cur = cur->next;
-			}
-			if (cur == nullptr)
-			{
-				return nullptr;
-			}
-
-			if (cur->size == size)
+			while (cur != nullptr)
 			{
-				if (prev == nullptr)
+				uintptr_t start = reinterpret_cast<uintptr_t>(cur);
+				uintptr_t aligned = AlignUp(start, alignment);
+				// Padding has to be able to hold a node of its own
+				while (aligned != start && aligned - start < sizeof(Node))
 				{
-					m_head = cur->next;
+					aligned += alignment;
 				}
-				else
+				size_t padding = aligned - start;
+				if (padding + size <= cur->size)
 				{
-					prev->next = cur->next;
+					size_t rest = cur->size - padding - size;
+					if (rest == 0 || rest >= sizeof(Node))
+					{
+						return Take(prev, cur, padding, size, rest);
+					}
 				}
-				return cur;
-			}
-
-			Node* split = reinterpret_cast<Node*>(reinterpret_cast<U8*>(cur) + size);
-			split->next = cur->next;
-			if (prev != nullptr)
-			{
-				prev->next = split;
-			}
-			else
-			{
-				m_head = split;
+				prev = cur;
+				cur = cur->next;
 			}
-			
-			split->size = cur->size - size;
-
-			return cur;
+			return nullptr;
 		}
 
 		virtual void Deallocate(void* data, size_t size) override
 		{
+			size = GetBlockSize(size);
 			Node* d = reinterpret_cast<Node*>(data);
 			d->size = size;
 
@@ -91,14 +87,52 @@ namespace tako::Allocators
 			d->next = cur;
 			Merge(prev, d);
 		}
+
+		virtual void Deallocate(void* data, size_t size, size_t alignment) override
+		{
+			Deallocate(data, size);
+		}
 	private:
 		void* m_data;
 		size_t m_size;
 		Node* m_head;
 
+		// Every block has to be able to turn back into a node once freed
+		static size_t GetBlockSize(size_t size)
+		{
+			return AlignUp(std::max(size, sizeof(Node)), alignof(Node));
+		}
+
+		void* Take(Node* prev, Node* cur, size_t padding, size_t size, size_t rest)
+		{
+			Node* next = cur->next;
+			if (rest > 0)
+			{
+				Node* split = reinterpret_cast<Node*>(reinterpret_cast<U8*>(cur) + padding + size);
+				split->next = next;
+				split->size = rest;
+				next = split;
+			}
+
+			if (padding > 0)
+			{
+				cur->size = padding;
+				cur->next = next;
+			}
+			else if (prev == nullptr)
+			{
+				m_head = next;
+			}
+			else
+			{
+				prev->next = next;
+			}
+			return reinterpret_cast<U8*>(cur) + padding;
+		}
+
 		void Merge(Node* prev, Node* mid)
 		{
-			if (mid->next != nullptr && (reinterpret_cast<U8*>(mid->next) + mid->size) == reinterpret_cast<U8*>(mid->next))
+			if (mid->next != nullptr && (reinterpret_cast<U8*>(mid) + mid->size) == reinterpret_cast<U8*>(mid->next))
 			{
 				mid->size += mid->next->size;
 				mid->next = mid->next->next;
@@ -1,6 +1,9 @@
 module;
 #include "Utility.hpp"
 #include "NumberTypes.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 export module Tako.Allocators.LinearAllocator;
 
 import Tako.Allocators.Allocator;
@@ -19,8 +22,20 @@ namespace tako::Allocators
 
 		virtual void* Allocate(size_t size) override
 		{
-			auto p = m_current;
-			m_current += size;
+			return Allocate(size, DefaultAlignment);
+		}
+
+		virtual void* Allocate(size_t size, size_t alignment) override
+		{
+			size_t padding = AlignUp(reinterpret_cast<uintptr_t>(m_current), alignment) - reinterpret_cast<uintptr_t>(m_current);
+			size_t available = m_dataSize - GetUsedSize();
+			if (padding > available || size > available - padding)
+			{
+				return nullptr;
+			}
+			auto p = m_current + padding;
+			m_current = p + size;
+			m_highWaterMark = std::max(m_highWaterMark, GetUsedSize());
 			return p;
 		}
 
@@ -28,15 +43,35 @@ namespace tako::Allocators
 		{
 		}
 
+		virtual void Deallocate(void* p, size_t size, size_t alignment) override
+		{
+		}
+
 		void Reset()
 		{
 			m_current = reinterpret_cast<std::byte*>(m_data);
 		}
 
+		size_t GetUsedSize() const
+		{
+			return m_current - reinterpret_cast<std::byte*>(m_data);
+		}
+
+		size_t GetCapacity() const
+		{
+			return m_dataSize;
+		}
+
+		// Most memory in use at once since creation
+		size_t GetHighWaterMark() const
+		{
+			return m_highWaterMark;
+		}
+
 	private:
 		void* m_data;
 		size_t m_dataSize;
-		size_t m_blockSize;
+		size_t m_highWaterMark = 0;
 		std::byte* m_current;
 	};
 }
@@ -1,6 +1,8 @@
 module;
 #include "Utility.hpp"
 #include "NumberTypes.hpp"
+#include <cstdint>
+#include <algorithm>
 export module Tako.Allocators.PoolAllocator;
 
 import Tako.Allocators.Allocator;
@@ -42,6 +44,18 @@ namespace tako::Allocators
 			return Allocate();
 		}
 
+		// Every block shares the same alignment, anything beyond it can't be served
+		virtual void* Allocate(size_t size, size_t alignment) override
+		{
+			ASSERT(m_blockSize == size);
+			if (alignment > m_blockAlignment)
+			{
+				return nullptr;
+			}
+
+			return Allocate();
+		}
+
 		void Deallocate(void* p)
 		{
 			Node* node = reinterpret_cast<Node*>(p);
@@ -56,15 +70,31 @@ namespace tako::Allocators
 			Deallocate(p);
 		}
 
+		virtual void Deallocate(void* p, size_t size, size_t alignment) override
+		{
+			ASSERT(m_blockSize == size);
+
+			Deallocate(p);
+		}
+
+		size_t GetBlockAlignment() const
+		{
+			return m_blockAlignment;
+		}
+
 	private:
 		void* m_data;
 		size_t m_dataSize;
 		size_t m_blockSize;
+		size_t m_blockAlignment;
 		Node* m_head;
 
 		void InitMemory()
 		{
 			ASSERT(m_dataSize >= sizeof(Node));
+			// Largest power of two dividing both the start and the block size
+			size_t start = reinterpret_cast<uintptr_t>(m_data);
+			m_blockAlignment = std::min(start & (~start + 1), m_blockSize & (~m_blockSize + 1));
 			m_head = nullptr;
 			size_t totalBlocks = m_dataSize / m_blockSize;
 			U8* p = reinterpret_cast<U8*>(m_data);
@@ -0,0 +1,347 @@
+module;
+#include "Utility.hpp"
+#include "NumberTypes.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <array>
+#include <memory>
+#include <cstdlib>
+#include <bit>
+#include <algorithm>
+#include <cstdint>
+export module Tako.Allocators.SizeClassAllocator;
+
+import Tako.Allocators.Allocator;
+
+namespace tako::Allocators
+{
+	// General purpose allocator that can be shared between threads.
+	// Requests are rounded up to power of two size classes, every thread keeps a small cache
+	// per class and only goes to the locked central free list to refill or flush a batch.
+	// Memory freed on another thread ends up in that thread's cache.
+	// A thread flushes its caches back to the central lists when it exits, its slot is then reused.
+	// Chunks are aligned to the largest class, so every block is aligned to its class size.
+	export class SizeClassAllocator final : public Allocator
+	{
+		struct Node
+		{
+			Node* next;
+		};
+
+		static constexpr size_t MinClassSize = 16;
+		static constexpr size_t MaxClassSize = 32 * 1024;
+		static constexpr size_t ClassCount = std::countr_zero(MaxClassSize) - std::countr_zero(MinClassSize) + 1;
+		static constexpr size_t ChunkSize = 256 * 1024;
+		static constexpr size_t ChunkAlignment = MaxClassSize;
+		static constexpr size_t BatchSize = 32;
+		static constexpr size_t MaxThreads = 256;
+
+		struct CentralList
+		{
+			std::mutex mutex;
+			Node* head = nullptr;
+		};
+
+		struct ThreadCache
+		{
+			struct List
+			{
+				Node* head = nullptr;
+				size_t count = 0;
+			};
+			std::array<List, ClassCount> lists;
+		};
+	public:
+		SizeClassAllocator()
+		{
+			auto& registry = GetRegistry();
+			std::lock_guard lock(registry.mutex);
+			registry.allocators.push_back(this);
+		}
+
+		SizeClassAllocator(const SizeClassAllocator&) = delete;
+		SizeClassAllocator& operator=(const SizeClassAllocator&) = delete;
+
+		// All threads have to be done with the allocator
+		~SizeClassAllocator()
+		{
+			{
+				auto& registry = GetRegistry();
+				std::lock_guard lock(registry.mutex);
+				std::erase(registry.allocators, this);
+			}
+			for (auto& cache : m_caches)
+			{
+				delete cache.load(std::memory_order_acquire);
+			}
+			for (auto chunk : m_chunks)
+			{
+				AlignedFree(chunk);
+			}
+		}
+
+		virtual void* Allocate(size_t size) override
+		{
+			if (size > MaxClassSize)
+			{
+				return AlignedAlloc(size, DefaultAlignment);
+			}
+			size_t sizeClass = GetSizeClass(size);
+			ThreadCache* cache = GetThreadCache();
+			if (cache == nullptr)
+			{
+				Node* node;
+				RefillFromCentral(sizeClass, node, 1);
+				return node;
+			}
+
+			auto& list = cache->lists[sizeClass];
+			if (list.head == nullptr)
+			{
+				list.count = RefillFromCentral(sizeClass, list.head, BatchSize);
+			}
+			Node* node = list.head;
+			list.head = node->next;
+			list.count--;
+			return node;
+		}
+
+		virtual void Deallocate(void* p, size_t size) override
+		{
+			if (p == nullptr)
+			{
+				return;
+			}
+			if (size > MaxClassSize)
+			{
+				AlignedFree(p);
+				return;
+			}
+			size_t sizeClass = GetSizeClass(size);
+			Node* node = reinterpret_cast<Node*>(p);
+			ThreadCache* cache = GetThreadCache();
+			if (cache == nullptr)
+			{
+				node->next = nullptr;
+				FlushToCentral(sizeClass, node, node);
+				return;
+			}
+
+			auto& list = cache->lists[sizeClass];
+			node->next = list.head;
+			list.head = node;
+			list.count++;
+			if (list.count >= 2 * BatchSize)
+			{
+				// Hand a batch back so memory freed here can be reused by other threads
+				Node* first = list.head;
+				Node* last = first;
+				for (size_t i = 1; i < BatchSize; i++)
+				{
+					last = last->next;
+				}
+				list.head = last->next;
+				list.count -= BatchSize;
+				FlushToCentral(sizeClass, first, last);
+			}
+		}
+		virtual void* Allocate(size_t size, size_t alignment) override
+		{
+			size_t classSize = std::max(size, alignment);
+			if (classSize > MaxClassSize)
+			{
+				return AlignedAlloc(size, alignment);
+			}
+			return Allocate(classSize);
+		}
+
+		virtual void Deallocate(void* p, size_t size, size_t alignment) override
+		{
+			size_t classSize = std::max(size, alignment);
+			if (classSize > MaxClassSize)
+			{
+				AlignedFree(p);
+				return;
+			}
+			Deallocate(p, classSize);
+		}
+	private:
+		std::array<CentralList, ClassCount> m_central;
+		std::array<std::atomic<ThreadCache*>, MaxThreads> m_caches = {};
+		std::mutex m_chunkMutex;
+		std::vector<void*> m_chunks;
+
+		// Thread slots are shared by all allocators, so a thread has the same slot in each of them
+		struct SlotRegistry
+		{
+			std::mutex mutex;
+			std::vector<size_t> freeSlots;
+			size_t nextSlot = 0;
+			std::vector<SizeClassAllocator*> allocators;
+		};
+
+		static constexpr size_t NoSlot = SIZE_MAX;
+		static constexpr size_t Unassigned = SIZE_MAX - 1;
+
+		// Gives the slot back when the thread exits
+		struct ThreadSlot
+		{
+			size_t index;
+
+			ThreadSlot() : index(Unassigned)
+			{
+			}
+
+			~ThreadSlot()
+			{
+				if (index < MaxThreads)
+				{
+					ReleaseSlot(index);
+				}
+			}
+		};
+
+		static inline thread_local ThreadSlot s_threadSlot;
+
+		static SlotRegistry& GetRegistry()
+		{
+			static SlotRegistry registry;
+			return registry;
+		}
+
+		static size_t AcquireSlot()
+		{
+			auto& registry = GetRegistry();
+			std::lock_guard lock(registry.mutex);
+			if (!registry.freeSlots.empty())
+			{
+				size_t slot = registry.freeSlots.back();
+				registry.freeSlots.pop_back();
+				return slot;
+			}
+			return registry.nextSlot < MaxThreads ? registry.nextSlot++ : NoSlot;
+		}
+
+		static void ReleaseSlot(size_t slot)
+		{
+			auto& registry = GetRegistry();
+			std::lock_guard lock(registry.mutex);
+			for (auto allocator : registry.allocators)
+			{
+				allocator->FlushThreadCache(slot);
+			}
+			registry.freeSlots.push_back(slot);
+		}
+
+		// Runs on the exiting thread that owns the slot, the empty cache stays for the next owner
+		void FlushThreadCache(size_t slot)
+		{
+			ThreadCache* cache = m_caches[slot].load(std::memory_order_relaxed);
+			if (cache == nullptr)
+			{
+				return;
+			}
+			for (size_t sizeClass = 0; sizeClass < ClassCount; sizeClass++)
+			{
+				auto& list = cache->lists[sizeClass];
+				if (list.head == nullptr)
+				{
+					continue;
+				}
+				Node* last = list.head;
+				while (last->next)
+				{
+					last = last->next;
+				}
+				FlushToCentral(sizeClass, list.head, last);
+				list.head = nullptr;
+				list.count = 0;
+			}
+		}
+
+		static size_t GetSizeClass(size_t size)
+		{
+			size = std::bit_ceil(std::max(size, MinClassSize));
+			return std::countr_zero(size) - std::countr_zero(MinClassSize);
+		}
+
+		static constexpr size_t GetClassSize(size_t sizeClass)
+		{
+			return MinClassSize << sizeClass;
+		}
+
+		// Threads beyond MaxThreads running at the same time go straight to the central lists
+		ThreadCache* GetThreadCache()
+		{
+			if (s_threadSlot.index == Unassigned)
+			{
+				s_threadSlot.index = AcquireSlot();
+			}
+			if (s_threadSlot.index >= MaxThreads)
+			{
+				return nullptr;
+			}
+			auto& slot = m_caches[s_threadSlot.index];
+			ThreadCache* cache = slot.load(std::memory_order_relaxed);
+			if (cache == nullptr)
+			{
+				cache = new ThreadCache();
+				slot.store(cache, std::memory_order_release);
+			}
+			return cache;
+		}
+
+		size_t RefillFromCentral(size_t sizeClass, Node*& head, size_t count)
+		{
+			auto& central = m_central[sizeClass];
+			std::lock_guard lock(central.mutex);
+			if (central.head == nullptr)
+			{
+				central.head = CarveChunk(sizeClass);
+			}
+
+			head = central.head;
+			Node* last = head;
+			size_t taken = 1;
+			while (taken < count && last->next)
+			{
+				last = last->next;
+				taken++;
+			}
+			central.head = last->next;
+			last->next = nullptr;
+			return taken;
+		}
+
+		void FlushToCentral(size_t sizeClass, Node* first, Node* last)
+		{
+			auto& central = m_central[sizeClass];
+			std::lock_guard lock(central.mutex);
+			last->next = central.head;
+			central.head = first;
+		}
+
+		Node* CarveChunk(size_t sizeClass)
+		{
+			void* chunk = AlignedAlloc(ChunkSize, ChunkAlignment);
+			ASSERT(chunk);
+			{
+				std::lock_guard lock(m_chunkMutex);
+				m_chunks.push_back(chunk);
+			}
+
+			size_t classSize = GetClassSize(sizeClass);
+			size_t blockCount = ChunkSize / classSize;
+			U8* p = reinterpret_cast<U8*>(chunk);
+			Node* head = nullptr;
+			for (size_t i = blockCount; i > 0; i--)
+			{
+				Node* node = reinterpret_cast<Node*>(p + (i - 1) * classSize);
+				node->next = head;
+				head = node;
+			}
+			return head;
+		}
+	};
+}
@@ -0,0 +1,303 @@
+module;
+#include "Utility.hpp"
+#include "NumberTypes.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+export module Tako.Allocators.StackAllocator;
+
+import Tako.Allocators.Allocator;
+import Tako.Allocators.TrackingAllocator;
+
+namespace tako::Allocators
+{
+	// Linear allocation that can be rolled back to a saved Marker, for nested temporary data.
+	// Either works on a fixed buffer, or owns its memory and chains further blocks when full.
+	// Blocks are kept after rolling back, so repeated use doesn't touch the heap.
+	export class StackAllocator final : public Allocator
+	{
+		struct Block
+		{
+			U8* data;
+			size_t size;
+		};
+	public:
+		struct Marker
+		{
+			size_t block;
+			size_t offset;
+		};
+
+		// Rolls back everything allocated during its lifetime
+		class Scope
+		{
+		public:
+			Scope(StackAllocator& allocator) : m_allocator(allocator), m_marker(allocator.GetMarker())
+			{
+			}
+
+			~Scope()
+			{
+				m_allocator.FreeToMarker(m_marker);
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		private:
+			StackAllocator& m_allocator;
+			Marker m_marker;
+		};
+
+		// Fixed, allocations fail once data is used up
+		StackAllocator(void* data, size_t dataSize) : m_ownsMemory(false), m_blockSize(0)
+		{
+			m_blocks.push_back({ reinterpret_cast<U8*>(data), dataSize });
+		}
+
+		// Growing, further blocks are at least blockSize big.
+		// The blocks are reported to tag when given, single allocations aren't tracked.
+		StackAllocator(size_t blockSize, AllocationTag* tag = nullptr) : m_ownsMemory(true), m_blockSize(blockSize), m_tag(tag)
+		{
+		}
+
+		~StackAllocator()
+		{
+			if (m_ownsMemory)
+			{
+				for (auto& block : m_blocks)
+				{
+					FreeBlock(block);
+				}
+			}
+		}
+
+		StackAllocator(const StackAllocator&) = delete;
+		StackAllocator& operator=(const StackAllocator&) = delete;
+
+		virtual void* Allocate(size_t size) override
+		{
+			return Allocate(size, DefaultAlignment);
+		}
+
+		virtual void* Allocate(size_t size, size_t alignment) override
+		{
+			while (m_current < m_blocks.size())
+			{
+				auto& block = m_blocks[m_current];
+				size_t offset = AlignUp(reinterpret_cast<uintptr_t>(block.data) + m_offset, alignment) - reinterpret_cast<uintptr_t>(block.data);
+				if (offset <= block.size && size <= block.size - offset)
+				{
+					m_offset = offset + size;
+					return block.data + offset;
+				}
+				if (m_current + 1 == m_blocks.size())
+				{
+					break;
+				}
+				m_current++;
+				m_offset = 0;
+			}
+
+			if (!m_ownsMemory)
+			{
+				return nullptr;
+			}
+
+			// Blocks are aligned to DefaultAlignment, bigger alignments need room to pad
+			size_t blockSize = std::max(m_blockSize, size + (alignment > DefaultAlignment ? alignment : 0));
+			U8* data = reinterpret_cast<U8*>(AlignedAlloc(blockSize, DefaultAlignment));
+			ASSERT(data);
+			if (m_tag)
+			{
+				m_tag->OnAllocate(blockSize);
+			}
+			m_current = m_blocks.empty() ? 0 : m_current + 1;
+			m_blocks.insert(m_blocks.begin() + m_current, { data, blockSize });
+			m_offset = 0;
+			return Allocate(size, alignment);
+		}
+
+		// Only the most recent allocation can be given back, anything else waits for FreeToMarker
+		virtual void Deallocate(void* p, size_t size) override
+		{
+			if (m_current < m_blocks.size() && reinterpret_cast<U8*>(p) + size == m_blocks[m_current].data + m_offset)
+			{
+				m_offset -= size;
+			}
+		}
+
+		virtual void Deallocate(void* p, size_t size, size_t alignment) override
+		{
+			Deallocate(p, size);
+		}
+
+		Marker GetMarker() const
+		{
+			return { m_current, m_offset };
+		}
+
+		void FreeToMarker(Marker marker)
+		{
+			ASSERT(marker.block < m_current || (marker.block == m_current && marker.offset <= m_offset));
+			m_current = marker.block;
+			m_offset = marker.offset;
+		}
+
+		void Reset()
+		{
+			FreeToMarker({ 0, 0 });
+		}
+
+		// Returns the memory of all blocks behind the current one
+		void ReleaseUnused()
+		{
+			if (!m_ownsMemory || m_blocks.empty())
+			{
+				return;
+			}
+			for (size_t i = m_current + 1; i < m_blocks.size(); i++)
+			{
+				FreeBlock(m_blocks[i]);
+			}
+			m_blocks.resize(m_current + 1);
+		}
+	private:
+		std::vector<Block> m_blocks;
+		size_t m_current = 0;
+		size_t m_offset = 0;
+		bool m_ownsMemory;
+		size_t m_blockSize;
+		AllocationTag* m_tag = nullptr;
+
+		void FreeBlock(const Block& block)
+		{
+			AlignedFree(block.data);
+			if (m_tag)
+			{
+				m_tag->OnDeallocate(block.size);
+			}
+		}
+	};
+
+	// Two stacks growing towards each other in one buffer, e.g. data that lives as long as
+	// the level at the bottom and frame temporaries at the top, without either fixing the split.
+	export class DoubleEndedStackAllocator
+	{
+	public:
+		enum class End
+		{
+			Bottom,
+			Top
+		};
+
+		struct Marker
+		{
+			End end;
+			size_t offset;
+		};
+
+		class Scope
+		{
+		public:
+			Scope(DoubleEndedStackAllocator& allocator, End end) : m_allocator(allocator), m_marker(allocator.GetMarker(end))
+			{
+			}
+
+			~Scope()
+			{
+				m_allocator.FreeToMarker(m_marker);
+			}
+
+			Scope(const Scope&) = delete;
+			Scope& operator=(const Scope&) = delete;
+		private:
+			DoubleEndedStackAllocator& m_allocator;
+			Marker m_marker;
+		};
+
+		DoubleEndedStackAllocator(void* data, size_t dataSize)
+		{
+			m_data = reinterpret_cast<U8*>(data);
+			m_dataSize = dataSize;
+			Reset();
+		}
+
+		void* Allocate(End end, size_t size, size_t alignment = Allocator::DefaultAlignment)
+		{
+			uintptr_t base = reinterpret_cast<uintptr_t>(m_data);
+			if (end == End::Bottom)
+			{
+				size_t offset = AlignUp(base + m_bottom, alignment) - base;
+				if (offset > m_top || size > m_top - offset)
+				{
+					return nullptr;
+				}
+				m_bottom = offset + size;
+				return m_data + offset;
+			}
+
+			if (size > m_top)
+			{
+				return nullptr;
+			}
+			uintptr_t aligned = (base + m_top - size) & ~(alignment - 1);
+			if (aligned < base + m_bottom)
+			{
+				return nullptr;
+			}
+			m_top = aligned - base;
+			return m_data + m_top;
+		}
+
+		Marker GetMarker(End end) const
+		{
+			return { end, end == End::Bottom ? m_bottom : m_top };
+		}
+
+		void FreeToMarker(Marker marker)
+		{
+			if (marker.end == End::Bottom)
+			{
+				ASSERT(marker.offset <= m_bottom);
+				m_bottom = marker.offset;
+			}
+			else
+			{
+				ASSERT(marker.offset >= m_top);
+				m_top = marker.offset;
+			}
+		}
+
+		void Reset(End end)
+		{
+			FreeToMarker({ end, end == End::Bottom ? 0 : m_dataSize });
+		}
+
+		void Reset()
+		{
+			m_bottom = 0;
+			m_top = m_dataSize;
+		}
+
+		size_t GetFreeSize() const
+		{
+			return m_top - m_bottom;
+		}
+	private:
+		U8* m_data;
+		size_t m_dataSize;
+		size_t m_bottom;
+		size_t m_top;
+	};
+
+	// Scratch memory for loaders on the current thread, roll back with a StackAllocator::Scope.
+	// The blocks of all threads count towards the "Level" tag.
+	export StackAllocator& GetLoadArena()
+	{
+		static AllocationTag tag("Level");
+		static thread_local StackAllocator arena(1024 * 1024, &tag);
+		return arena;
+	}
+}
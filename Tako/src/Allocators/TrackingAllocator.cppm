@@ -0,0 +1,212 @@
+module;
+#include "Utility.hpp"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+export module Tako.Allocators.TrackingAllocator;
+
+import Tako.Allocators.Allocator;
+
+namespace tako::Allocators
+{
+	export struct AllocationStats
+	{
+		const char* name;
+		size_t currentBytes;
+		size_t peakBytes;
+		size_t liveAllocations;
+		size_t totalAllocations;
+		size_t budget;
+		size_t overflows;
+		size_t failedAllocations;
+	};
+
+	// Accounting for one kind of memory, shared by any number of tracking allocators.
+	// Tags register themselves so they can be listed at runtime, they have to outlive their allocators.
+	export class AllocationTag
+	{
+	public:
+		// A budget of 0 means unlimited, otherwise exceeding it counts as overflow
+		AllocationTag(const char* name, size_t budget = 0) : m_name(name), m_budget(budget)
+		{
+			std::lock_guard lock(GetRegistryMutex());
+			GetRegistry().push_back(this);
+		}
+
+		~AllocationTag()
+		{
+			std::lock_guard lock(GetRegistryMutex());
+			auto& registry = GetRegistry();
+			registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+		}
+
+		AllocationTag(const AllocationTag&) = delete;
+		AllocationTag& operator=(const AllocationTag&) = delete;
+
+		void OnAllocate(size_t size)
+		{
+			size_t current = m_currentBytes.fetch_add(size, std::memory_order_relaxed) + size;
+			m_liveAllocations.fetch_add(1, std::memory_order_relaxed);
+			m_totalAllocations.fetch_add(1, std::memory_order_relaxed);
+
+			size_t peak = m_peakBytes.load(std::memory_order_relaxed);
+			while (current > peak && !m_peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed));
+
+			if (m_budget > 0 && current > m_budget)
+			{
+				if (m_overflows.fetch_add(1, std::memory_order_relaxed) == 0)
+				{
+					LOG_WARN("Allocation tag {} exceeded its budget: {} > {} bytes", m_name, current, m_budget);
+				}
+			}
+		}
+
+		void OnDeallocate(size_t size)
+		{
+			ASSERT(m_currentBytes.load(std::memory_order_relaxed) >= size);
+			m_currentBytes.fetch_sub(size, std::memory_order_relaxed);
+			m_liveAllocations.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		void OnFailedAllocation(size_t size)
+		{
+			if (m_failedAllocations.fetch_add(1, std::memory_order_relaxed) == 0)
+			{
+				LOG_ERR("Allocation tag {} failed to allocate {} bytes", m_name, size);
+			}
+		}
+
+		// For allocators that release everything at once, like LinearAllocator::Reset
+		void OnReset()
+		{
+			m_currentBytes.store(0, std::memory_order_relaxed);
+			m_liveAllocations.store(0, std::memory_order_relaxed);
+		}
+
+		// Raises the peak to what an arena really used, for arenas that aren't tracked per allocation
+		void OnHighWaterMark(size_t bytes)
+		{
+			size_t peak = m_peakBytes.load(std::memory_order_relaxed);
+			while (bytes > peak && !m_peakBytes.compare_exchange_weak(peak, bytes, std::memory_order_relaxed));
+		}
+
+		void SetBudget(size_t budget)
+		{
+			m_budget = budget;
+		}
+
+		AllocationStats GetStats() const
+		{
+			return
+			{
+				m_name,
+				m_currentBytes.load(std::memory_order_relaxed),
+				m_peakBytes.load(std::memory_order_relaxed),
+				m_liveAllocations.load(std::memory_order_relaxed),
+				m_totalAllocations.load(std::memory_order_relaxed),
+				m_budget,
+				m_overflows.load(std::memory_order_relaxed),
+				m_failedAllocations.load(std::memory_order_relaxed)
+			};
+		}
+
+		static std::vector<AllocationStats> GetAllStats()
+		{
+			std::lock_guard lock(GetRegistryMutex());
+			std::vector<AllocationStats> stats;
+			for (auto tag : GetRegistry())
+			{
+				stats.push_back(tag->GetStats());
+			}
+			return stats;
+		}
+	private:
+		const char* m_name;
+		size_t m_budget;
+		std::atomic<size_t> m_currentBytes = 0;
+		std::atomic<size_t> m_peakBytes = 0;
+		std::atomic<size_t> m_liveAllocations = 0;
+		std::atomic<size_t> m_totalAllocations = 0;
+		std::atomic<size_t> m_overflows = 0;
+		std::atomic<size_t> m_failedAllocations = 0;
+
+		static std::vector<AllocationTag*>& GetRegistry()
+		{
+			static std::vector<AllocationTag*> registry;
+			return registry;
+		}
+
+		static std::mutex& GetRegistryMutex()
+		{
+			static std::mutex mutex;
+			return mutex;
+		}
+	};
+
+	// Forwards to another allocator and reports every call to its tag
+	export class TrackingAllocator final : public Allocator
+	{
+	public:
+		TrackingAllocator(Allocator& allocator, AllocationTag& tag) : m_allocator(allocator), m_tag(tag)
+		{
+		}
+
+		virtual void* Allocate(size_t size) override
+		{
+			void* p = m_allocator.Allocate(size);
+			if (p == nullptr)
+			{
+				m_tag.OnFailedAllocation(size);
+				return nullptr;
+			}
+			m_tag.OnAllocate(size);
+			return p;
+		}
+
+		virtual void Deallocate(void* p, size_t size) override
+		{
+			if (p == nullptr)
+			{
+				return;
+			}
+			m_allocator.Deallocate(p, size);
+			m_tag.OnDeallocate(size);
+		}
+
+		virtual void* Allocate(size_t size, size_t alignment) override
+		{
+			void* p = m_allocator.Allocate(size, alignment);
+			if (p == nullptr)
+			{
+				m_tag.OnFailedAllocation(size);
+				return nullptr;
+			}
+			m_tag.OnAllocate(size);
+			return p;
+		}
+
+		virtual void Deallocate(void* p, size_t size, size_t alignment) override
+		{
+			if (p == nullptr)
+			{
+				return;
+			}
+			m_allocator.Deallocate(p, size, alignment);
+			m_tag.OnDeallocate(size);
+		}
+
+		Allocator& GetAllocator()
+		{
+			return m_allocator;
+		}
+
+		AllocationTag& GetTag()
+		{
+			return m_tag;
+		}
+	private:
+		Allocator& m_allocator;
+		AllocationTag& m_tag;
+	};
+}
@@ -9,6 +9,7 @@ export module Tako.Bitmap;
 
 import Tako.Math;
 import Tako.Assets;
+import Tako.IO;
 import Tako.StringView;
 import Tako.NumberTypes;
 
@@ -240,16 +241,13 @@ namespace tako
 
 	Bitmap Bitmap::FromFile(CStringView filePath)
 	{
-		tako::U8* buffer = new tako::U8[5242880];
-		size_t bytesRead = 0;
-		tako::Assets::ReadAssetFile(filePath, buffer, 5242880, bytesRead);
-		int width, height, channels;
-		stbi_uc* img = stbi_load_from_memory(buffer, bytesRead, &width, &height, &channels, 4);
-		Bitmap bitmap((Color*)img, width, height);
-		stbi_image_free(img);
-		delete[] buffer;
-
-		return std::move(bitmap);
+		auto file = IO::Map(Assets::GetAssetPath(filePath));
+		if (!file.IsValid())
+		{
+			LOG_ERR("Can't open image {}", filePath.c_str());
+			return {};
+		}
+		return FromFileData(file.GetData(), file.GetSize());
 	}
 
 	Bitmap Bitmap::FromFileData(const U8* data, size_t size)
@@ -2,7 +2,6 @@ module;
 #include "NumberTypes.hpp"
 #include "Entity.hpp"
 #include "Utility.hpp"
-#include <unordered_map>
 #include <functional>
 #include <tuple>
 #include <array>
@@ -16,6 +15,8 @@ module;
 
 export module Tako.World;
 
+import Tako.FlatHashMap;
+
 namespace tako
 {
 // Archetype
@@ -559,6 +560,9 @@ namespace tako
 	};
 
 
+	// Archetypes stay boxed, entity handles point at them while the map rehashes
+	using ArchetypeMap = FlatHashMap<U64, std::unique_ptr<Archetype>>;
+
 	export template<typename... Cs>
 	class ComponentIterator;
 
@@ -572,7 +576,7 @@ namespace tako
 
 		Entity Create()
 		{
-			return CreateEntityInArchetype(m_archetypes[0]);
+			return CreateEntityInArchetype(*m_archetypes[0]);
 		}
 
 		template<typename... Cs, typename = std::enable_if<(sizeof...(Cs) > 0)>>
@@ -582,9 +586,9 @@ namespace tako
 			auto iter = m_archetypes.find(hash);
 			if (iter == m_archetypes.end())
 			{
-				m_archetypes[hash] = Archetype::Create<Cs...>();
+				iter = m_archetypes.try_emplace(hash, std::make_unique<Archetype>(Archetype::Create<Cs...>())).first;
 			}
-			Archetype& arch = m_archetypes[hash];
+			Archetype& arch = *iter->second;
 			return CreateEntityInArchetype(arch);
 		}
 
@@ -686,10 +690,10 @@ namespace tako
 				U64 archHash = pair.first;
 				if ((archHash & hash) == hash)
 				{
-					handle.archeType = &pair.second;
-					for (int ch = 0; ch < pair.second.chunks.size(); ch++)
+					handle.archeType = pair.second.get();
+					for (int ch = 0; ch < pair.second->chunks.size(); ch++)
 					{
-						auto& chunk = *pair.second.chunks[ch];
+						auto& chunk = *pair.second->chunks[ch];
 						Entity* entities = handle.archeType->GetArray<Entity>(chunk);
 						handle.chunk = &chunk;
 						for (int i = 0; i < chunk.header.last; i++)
@@ -713,7 +717,7 @@ namespace tako
 				U64 archHash = pair.first;
 				if ((archHash & hash) == hash)
 				{
-					auto& arch = pair.second;
+					auto& arch = *pair.second;
 					auto chunkSize = arch.chunks.size();
 					for (int ch = 0; ch < chunkSize; ++ch)
 					{
@@ -741,7 +745,7 @@ namespace tako
 				U64 archHash = pair.first;
 				if ((archHash & hash) == hash)
 				{
-					auto& arch = pair.second;
+					auto& arch = *pair.second;
 					auto chunkSize = arch.chunks.size();
 					for (int ch = 0; ch < chunkSize; ++ch)
 					{
@@ -780,7 +784,7 @@ namespace tako
 			})
 			| std::views::transform([componentID = EntityTupleHelper<Cs...>::GetIDArray()](auto& pair)
 			{
-				auto& arch = pair.second;
+				auto& arch = *pair.second;
 				return arch.chunks | std::views::transform([&](auto& chunk)
 				{
 					auto comps = EntityTupleHelper<Cs...>::GetComponentArrays(arch, *chunk, componentID);
@@ -815,7 +819,7 @@ namespace tako
 		std::vector<EntityHandle> m_entities;
 		U32 m_nextDeleted = 0;
 		std::size_t m_deletedCount = 0;
-		std::unordered_map<U64, Archetype> m_archetypes;
+		ArchetypeMap m_archetypes;
 
 		Entity CreateEntityInArchetype(Archetype& arch)
 		{
@@ -858,16 +862,11 @@ namespace tako
 		void MoveEntityArchetype(EntityHandle handle, U64 targetHash)
 		{
 			auto iter = m_archetypes.find(targetHash);
-			Archetype* targetArch;
 			if (iter == m_archetypes.end())
 			{
-				m_archetypes[targetHash] = Archetype::Create(targetHash);
-				targetArch = &m_archetypes[targetHash];
-			}
-			else
-			{
-				targetArch = &iter->second;
+				iter = m_archetypes.try_emplace(targetHash, std::make_unique<Archetype>(Archetype::Create(targetHash))).first;
 			}
+			Archetype* targetArch = iter->second.get();
 
 			auto targetHandle = targetArch->AddEntity(handle.id);
 			targetArch->CopyComponentData(handle, *targetHandle.chunk, handle.id, targetHandle.indexChunk);
@@ -877,7 +876,7 @@ namespace tako
 
 		void CreateEmptyArchetype()
 		{
-			m_archetypes.insert({ 0, Archetype::Create<>() });
+			m_archetypes.try_emplace(0, std::make_unique<Archetype>(Archetype::Create<>()));
 		}
 	};
 
@@ -885,7 +884,7 @@ namespace tako
 	class ComponentIterator
 	{
 	public:
-		ComponentIterator(std::unordered_map<U64, Archetype>::const_iterator begin, std::unordered_map<U64, Archetype>::const_iterator end)
+		ComponentIterator(ArchetypeMap::const_iterator begin, ArchetypeMap::const_iterator end)
 		{
 			m_archetypesIter = begin;
 			m_archetypesEnd = end;
@@ -949,16 +948,16 @@ namespace tako
 		int m_indexChunks;
 		int m_chunksSize;
 		std::tuple<Cs*...> m_componentArray;
-		std::unordered_map<U64, Archetype>::const_iterator m_archetypesIter;
-		std::unordered_map<U64, Archetype>::const_iterator m_archetypesEnd;
+		ArchetypeMap::const_iterator m_archetypesIter;
+		ArchetypeMap::const_iterator m_archetypesEnd;
 		U64 hash;
 		std::array<U8,sizeof...(Cs)> componentID;
 
 		inline void SetupChunk()
 		{
 			auto& pair = *m_archetypesIter;
-			Chunk& chunk = *pair.second.chunks[m_indexChunks];
-			m_componentArray = GetComponentArrays(pair.second, chunk, std::index_sequence_for<Cs...>{});
+			Chunk& chunk = *pair.second->chunks[m_indexChunks];
+			m_componentArray = GetComponentArrays(*pair.second, chunk, std::index_sequence_for<Cs...>{});
 			m_indexComponentArray = 0;
 			m_componentArraySize = chunk.header.last;
 			//TODO: what if array is empty?
@@ -990,7 +989,7 @@ namespace tako
 					continue;
 				}
 
-				m_chunksSize = pair.second.chunks.size();
+				m_chunksSize = pair.second->chunks.size();
 				m_indexChunks = 0;
 				SetupChunk();
 				break;
@@ -0,0 +1,681 @@
+module;
+#include "Utility.hpp"
+#include "NumberTypes.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <bit>
+#include <memory>
+#include <utility>
+#include <iterator>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TAKO_FLAT_HASH_SSE2
+#endif
+export module Tako.FlatHashMap;
+
+import Tako.Hash;
+import Tako.Allocators.Allocator;
+
+namespace tako
+{
+	// Default hasher, integers get mixed since the table masks the hash instead of using a prime modulo
+	export template<typename K>
+	struct FlatHash
+	{
+		U64 operator()(const K& key) const
+		{
+			if constexpr (std::is_integral_v<K> || std::is_enum_v<K>)
+			{
+				return Hash::HashInt(static_cast<U64>(key));
+			}
+			else if constexpr (std::is_pointer_v<K>)
+			{
+				return Hash::HashInt(reinterpret_cast<uintptr_t>(key));
+			}
+			else
+			{
+				return Hash::HashInt(std::hash<K>{}(key));
+			}
+		}
+	};
+
+	// Strings can be looked up by string_view without building a key
+	export template<>
+	struct FlatHash<std::string>
+	{
+		using is_transparent = void;
+
+		U64 operator()(std::string_view str) const
+		{
+			return Hash::HashStr(str);
+		}
+	};
+
+	export template<>
+	struct FlatHash<std::string_view>
+	{
+		using is_transparent = void;
+
+		U64 operator()(std::string_view str) const
+		{
+			return Hash::HashStr(str);
+		}
+	};
+
+	namespace Detail
+	{
+		constexpr size_t GroupSize = 16;
+		// Control bytes: full slots store the low 7 bits of the hash, the special values have the top bit set
+		constexpr I8 CtrlEmpty = -128;
+		constexpr I8 CtrlDeleted = -2;
+
+		// Bit i is set if control byte i of the group matched
+		class Group
+		{
+		public:
+			explicit Group(const I8* ctrl)
+			{
+#ifdef TAKO_FLAT_HASH_SSE2
+				m_ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+#else
+				std::memcpy(m_ctrl, ctrl, GroupSize);
+#endif
+			}
+
+			U32 Match(I8 h2) const
+			{
+#ifdef TAKO_FLAT_HASH_SSE2
+				return static_cast<U32>(_mm_movemask_epi8(_mm_cmpeq_epi8(m_ctrl, _mm_set1_epi8(h2))));
+#else
+				U32 mask = 0;
+				for (size_t i = 0; i < GroupSize; i++)
+				{
+					mask |= U32(m_ctrl[i] == h2) << i;
+				}
+				return mask;
+#endif
+			}
+
+			U32 MatchEmpty() const
+			{
+				return Match(CtrlEmpty);
+			}
+
+			U32 MatchEmptyOrDeleted() const
+			{
+#ifdef TAKO_FLAT_HASH_SSE2
+				return static_cast<U32>(_mm_movemask_epi8(_mm_cmplt_epi8(m_ctrl, _mm_set1_epi8(-1))));
+#else
+				U32 mask = 0;
+				for (size_t i = 0; i < GroupSize; i++)
+				{
+					mask |= U32(m_ctrl[i] < -1) << i;
+				}
+				return mask;
+#endif
+			}
+		private:
+#ifdef TAKO_FLAT_HASH_SSE2
+			__m128i m_ctrl;
+#else
+			I8 m_ctrl[GroupSize];
+#endif
+		};
+	}
+
+	// Open addressing hash map in the style of a swiss table: a control byte per slot,
+	// probed 16 at a time, with keys and values stored inline in one allocation.
+	// Any insert can move elements, so pointers and iterators are only stable until the next insert.
+	export template<typename K, typename V, typename Hash = FlatHash<K>, typename Eq = std::equal_to<>>
+	class FlatHashMap
+	{
+		using Group = Detail::Group;
+		static constexpr size_t GroupSize = Detail::GroupSize;
+	public:
+		using key_type = K;
+		using mapped_type = V;
+		// Keys can't be changed in place, that would put them in the wrong slot
+		using value_type = std::pair<const K, V>;
+
+		template<bool IsConst>
+		class Iterator
+		{
+			using Slot = std::conditional_t<IsConst, const std::pair<const K, V>, std::pair<const K, V>>;
+		public:
+			using iterator_concept = std::forward_iterator_tag;
+			using iterator_category = std::forward_iterator_tag;
+			using value_type = std::pair<const K, V>;
+			using difference_type = std::ptrdiff_t;
+			using pointer = Slot*;
+			using reference = Slot&;
+
+			Iterator() = default;
+
+			Iterator(const I8* ctrl, const I8* ctrlEnd, Slot* slot) : m_ctrl(ctrl), m_ctrlEnd(ctrlEnd), m_slot(slot)
+			{
+				SkipEmpty();
+			}
+
+			template<bool WasConst> requires (IsConst && !WasConst)
+			Iterator(const Iterator<WasConst>& other) : m_ctrl(other.m_ctrl), m_ctrlEnd(other.m_ctrlEnd), m_slot(other.m_slot)
+			{
+			}
+
+			reference operator*() const
+			{
+				return *m_slot;
+			}
+
+			pointer operator->() const
+			{
+				return m_slot;
+			}
+
+			Iterator& operator++()
+			{
+				m_ctrl++;
+				m_slot++;
+				SkipEmpty();
+				return *this;
+			}
+
+			Iterator operator++(int)
+			{
+				Iterator tmp = *this;
+				++(*this);
+				return tmp;
+			}
+
+			bool operator==(const Iterator& other) const
+			{
+				return m_ctrl == other.m_ctrl;
+			}
+		private:
+			void SkipEmpty()
+			{
+				while (m_ctrl != m_ctrlEnd && *m_ctrl < 0)
+				{
+					m_ctrl++;
+					m_slot++;
+				}
+			}
+
+			const I8* m_ctrl = nullptr;
+			const I8* m_ctrlEnd = nullptr;
+			Slot* m_slot = nullptr;
+
+			friend class FlatHashMap;
+			template<bool> friend class Iterator;
+		};
+
+		using iterator = Iterator<false>;
+		using const_iterator = Iterator<true>;
+
+		FlatHashMap() = default;
+
+		FlatHashMap(size_t capacity)
+		{
+			reserve(capacity);
+		}
+
+		~FlatHashMap()
+		{
+			DestroyAll();
+			FreeTable();
+		}
+
+		FlatHashMap(const FlatHashMap& other)
+		{
+			reserve(other.m_size);
+			for (auto& [key, value] : other)
+			{
+				try_emplace(key, value);
+			}
+		}
+
+		FlatHashMap& operator=(const FlatHashMap& other)
+		{
+			if (this != &other)
+			{
+				clear();
+				reserve(other.m_size);
+				for (auto& [key, value] : other)
+				{
+					try_emplace(key, value);
+				}
+			}
+			return *this;
+		}
+
+		FlatHashMap(FlatHashMap&& other) noexcept
+		{
+			TakeFrom(other);
+		}
+
+		FlatHashMap& operator=(FlatHashMap&& other) noexcept
+		{
+			if (this != &other)
+			{
+				DestroyAll();
+				FreeTable();
+				TakeFrom(other);
+			}
+			return *this;
+		}
+
+		size_t size() const
+		{
+			return m_size;
+		}
+
+		bool empty() const
+		{
+			return m_size == 0;
+		}
+
+		size_t capacity() const
+		{
+			return m_capacity;
+		}
+
+		iterator begin()
+		{
+			return { m_ctrl, m_ctrl + m_capacity, m_slots };
+		}
+
+		iterator end()
+		{
+			return { m_ctrl + m_capacity, m_ctrl + m_capacity, m_slots + m_capacity };
+		}
+
+		const_iterator begin() const
+		{
+			return { m_ctrl, m_ctrl + m_capacity, m_slots };
+		}
+
+		const_iterator end() const
+		{
+			return { m_ctrl + m_capacity, m_ctrl + m_capacity, m_slots + m_capacity };
+		}
+
+		// Q can differ from K if the hasher is transparent, e.g. string_view for string keys
+		template<typename Q = K>
+		iterator find(const Q& key)
+		{
+			size_t index = FindIndex(key);
+			return index == NotFound ? end() : IteratorAt(index);
+		}
+
+		template<typename Q = K>
+		const_iterator find(const Q& key) const
+		{
+			size_t index = FindIndex(key);
+			return index == NotFound ? end() : const_iterator(IteratorAt(index));
+		}
+
+		template<typename Q = K>
+		bool contains(const Q& key) const
+		{
+			return FindIndex(key) != NotFound;
+		}
+
+		template<typename Q = K>
+		size_t count(const Q& key) const
+		{
+			return contains(key) ? 1 : 0;
+		}
+
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(const K& key, Args&&... args)
+		{
+			return TryEmplaceImpl(key, std::forward<Args>(args)...);
+		}
+
+		template<typename... Args>
+		std::pair<iterator, bool> try_emplace(K&& key, Args&&... args)
+		{
+			return TryEmplaceImpl(std::move(key), std::forward<Args>(args)...);
+		}
+
+		template<typename KeyArg, typename ValueArg>
+		std::pair<iterator, bool> emplace(KeyArg&& key, ValueArg&& value)
+		{
+			return TryEmplaceImpl(K(std::forward<KeyArg>(key)), std::forward<ValueArg>(value));
+		}
+
+		std::pair<iterator, bool> insert(const value_type& value)
+		{
+			return TryEmplaceImpl(value.first, value.second);
+		}
+
+		std::pair<iterator, bool> insert(value_type&& value)
+		{
+			return TryEmplaceImpl(std::move(value.first), std::move(value.second));
+		}
+
+		template<typename Arg>
+		std::pair<iterator, bool> insert_or_assign(const K& key, Arg&& value)
+		{
+			auto result = TryEmplaceImpl(key, std::forward<Arg>(value));
+			if (!result.second)
+			{
+				result.first->second = std::forward<Arg>(value);
+			}
+			return result;
+		}
+
+		V& operator[](const K& key)
+		{
+			return TryEmplaceImpl(key).first->second;
+		}
+
+		V& operator[](K&& key)
+		{
+			return TryEmplaceImpl(std::move(key)).first->second;
+		}
+
+		template<typename Q = K>
+		V& at(const Q& key)
+		{
+			size_t index = FindIndex(key);
+			ASSERT(index != NotFound);
+			return m_slots[index].second;
+		}
+
+		template<typename Q = K>
+		const V& at(const Q& key) const
+		{
+			size_t index = FindIndex(key);
+			ASSERT(index != NotFound);
+			return m_slots[index].second;
+		}
+
+		template<typename Q = K>
+		size_t erase(const Q& key) requires (!std::is_convertible_v<const Q&, const_iterator>)
+		{
+			size_t index = FindIndex(key);
+			if (index == NotFound)
+			{
+				return 0;
+			}
+			EraseAt(index);
+			return 1;
+		}
+
+		// Erasing never moves other elements, so iteration can continue from the returned iterator
+		iterator erase(const_iterator it)
+		{
+			size_t index = it.m_ctrl - m_ctrl;
+			EraseAt(index);
+			iterator next = IteratorAt(index);
+			++next;
+			return next;
+		}
+
+		iterator erase(iterator it)
+		{
+			return erase(const_iterator(it));
+		}
+
+		void clear()
+		{
+			DestroyAll();
+			if (m_capacity > 0)
+			{
+				std::memset(m_ctrl, Detail::CtrlEmpty, m_capacity);
+			}
+			m_size = 0;
+			m_growthLeft = MaxLoad(m_capacity);
+		}
+
+		// Makes room for count elements without further rehashing
+		void reserve(size_t count)
+		{
+			if (count <= MaxLoad(m_capacity))
+			{
+				return;
+			}
+			size_t newCapacity = GroupSize;
+			while (MaxLoad(newCapacity) < count)
+			{
+				newCapacity *= 2;
+			}
+			Rehash(newCapacity);
+		}
+	private:
+		static constexpr size_t NotFound = ~size_t(0);
+
+		// Load factor of 7/8, low enough that every probe sequence reaches an empty slot
+		static constexpr size_t MaxLoad(size_t capacity)
+		{
+			return capacity - capacity / 8;
+		}
+
+		static size_t H1(U64 hash)
+		{
+			return static_cast<size_t>(hash >> 7);
+		}
+
+		static I8 H2(U64 hash)
+		{
+			return static_cast<I8>(hash & 0x7F);
+		}
+
+		template<typename Q>
+		U64 HashKey(const Q& key) const
+		{
+			return static_cast<U64>(Hash{}(key));
+		}
+
+		iterator IteratorAt(size_t index)
+		{
+			iterator it;
+			it.m_ctrl = m_ctrl + index;
+			it.m_ctrlEnd = m_ctrl + m_capacity;
+			it.m_slot = m_slots + index;
+			return it;
+		}
+
+		const_iterator IteratorAt(size_t index) const
+		{
+			const_iterator it;
+			it.m_ctrl = m_ctrl + index;
+			it.m_ctrlEnd = m_ctrl + m_capacity;
+			it.m_slot = m_slots + index;
+			return it;
+		}
+
+		// Visits whole groups with triangular steps, which reaches every group for power of two counts
+		template<typename Q>
+		size_t FindIndex(const Q& key) const
+		{
+			if (m_size == 0)
+			{
+				return NotFound;
+			}
+
+			U64 hash = HashKey(key);
+			I8 h2 = H2(hash);
+			size_t groupMask = m_capacity / GroupSize - 1;
+			size_t group = H1(hash) & groupMask;
+			for (size_t step = 1; ; step++)
+			{
+				Group g(m_ctrl + group * GroupSize);
+				for (U32 mask = g.Match(h2); mask != 0; mask &= mask - 1)
+				{
+					size_t index = group * GroupSize + std::countr_zero(mask);
+					if (Eq{}(m_slots[index].first, key))
+					{
+						return index;
+					}
+				}
+				if (g.MatchEmpty() != 0)
+				{
+					return NotFound;
+				}
+				group = (group + step) & groupMask;
+			}
+		}
+
+		size_t FindInsertIndex(U64 hash) const
+		{
+			size_t groupMask = m_capacity / GroupSize - 1;
+			size_t group = H1(hash) & groupMask;
+			for (size_t step = 1; ; step++)
+			{
+				U32 mask = Group(m_ctrl + group * GroupSize).MatchEmptyOrDeleted();
+				if (mask != 0)
+				{
+					return group * GroupSize + std::countr_zero(mask);
+				}
+				group = (group + step) & groupMask;
+			}
+		}
+
+		template<typename KeyArg, typename... Args>
+		std::pair<iterator, bool> TryEmplaceImpl(KeyArg&& key, Args&&... args)
+		{
+			size_t found = FindIndex(key);
+			if (found != NotFound)
+			{
+				return { IteratorAt(found), false };
+			}
+
+			if (m_capacity == 0)
+			{
+				Rehash(GroupSize);
+			}
+			U64 hash = HashKey(key);
+			size_t index = FindInsertIndex(hash);
+			if (m_growthLeft == 0 && m_ctrl[index] == Detail::CtrlEmpty)
+			{
+				// Out of empty slots, drop the tombstones if they make up enough of the table, otherwise grow
+				Rehash(m_size + 1 > MaxLoad(m_capacity) / 2 ? m_capacity * 2 : m_capacity);
+				index = FindInsertIndex(hash);
+			}
+
+			if (m_ctrl[index] == Detail::CtrlEmpty)
+			{
+				m_growthLeft--;
+			}
+			new(m_slots + index) value_type(std::piecewise_construct,
+				std::forward_as_tuple(std::forward<KeyArg>(key)),
+				std::forward_as_tuple(std::forward<Args>(args)...));
+			m_ctrl[index] = H2(hash);
+			m_size++;
+			return { IteratorAt(index), true };
+		}
+
+		void EraseAt(size_t index)
+		{
+			ASSERT(index < m_capacity && m_ctrl[index] >= 0);
+			m_slots[index].~value_type();
+			m_size--;
+			// A group that still has an empty slot ends every probe passing through it,
+			// so the slot can become empty again. Otherwise later probes need to skip over it.
+			size_t groupStart = index & ~(GroupSize - 1);
+			if (Group(m_ctrl + groupStart).MatchEmpty() != 0)
+			{
+				m_ctrl[index] = Detail::CtrlEmpty;
+				m_growthLeft++;
+			}
+			else
+			{
+				m_ctrl[index] = Detail::CtrlDeleted;
+			}
+		}
+
+		void Rehash(size_t newCapacity)
+		{
+			I8* oldCtrl = m_ctrl;
+			value_type* oldSlots = m_slots;
+			size_t oldCapacity = m_capacity;
+
+			AllocateTable(newCapacity);
+			m_growthLeft = MaxLoad(newCapacity) - m_size;
+			for (size_t i = 0; i < oldCapacity; i++)
+			{
+				if (oldCtrl[i] >= 0)
+				{
+					U64 hash = HashKey(oldSlots[i].first);
+					size_t index = FindInsertIndex(hash);
+					// The old slot is destroyed right after, so its key can be moved from
+					new(m_slots + index) value_type(std::move(const_cast<K&>(oldSlots[i].first)), std::move(oldSlots[i].second));
+					oldSlots[i].~value_type();
+					m_ctrl[index] = H2(hash);
+				}
+			}
+
+			if (oldCtrl)
+			{
+				AlignedFree(oldCtrl);
+			}
+		}
+
+		// Control bytes and slots share one allocation, the slots start behind the padded control bytes
+		void AllocateTable(size_t capacity)
+		{
+			constexpr size_t alignment = alignof(value_type) > GroupSize ? alignof(value_type) : GroupSize;
+			size_t slotOffset = AlignUp(capacity, alignof(value_type));
+			U8* data = reinterpret_cast<U8*>(AlignedAlloc(slotOffset + capacity * sizeof(value_type), alignment));
+			ASSERT(data);
+			m_ctrl = reinterpret_cast<I8*>(data);
+			m_slots = reinterpret_cast<value_type*>(data + slotOffset);
+			m_capacity = capacity;
+			std::memset(m_ctrl, Detail::CtrlEmpty, capacity);
+		}
+
+		void DestroyAll()
+		{
+			if constexpr (!std::is_trivially_destructible_v<value_type>)
+			{
+				for (size_t i = 0; i < m_capacity; i++)
+				{
+					if (m_ctrl[i] >= 0)
+					{
+						m_slots[i].~value_type();
+					}
+				}
+			}
+		}
+
+		void FreeTable()
+		{
+			if (m_ctrl)
+			{
+				AlignedFree(m_ctrl);
+			}
+			m_ctrl = nullptr;
+			m_slots = nullptr;
+			m_capacity = 0;
+			m_size = 0;
+			m_growthLeft = 0;
+		}
+
+		void TakeFrom(FlatHashMap& other)
+		{
+			m_ctrl = other.m_ctrl;
+			m_slots = other.m_slots;
+			m_capacity = other.m_capacity;
+			m_size = other.m_size;
+			m_growthLeft = other.m_growthLeft;
+			other.m_ctrl = nullptr;
+			other.m_slots = nullptr;
+			other.m_capacity = 0;
+			other.m_size = 0;
+			other.m_growthLeft = 0;
+		}
+
+		I8* m_ctrl = nullptr;
+		value_type* m_slots = nullptr;
+		size_t m_capacity = 0;
+		size_t m_size = 0;
+		// Empty slots that can still be filled before the load factor is exceeded
+		size_t m_growthLeft = 0;
+	};
+}
@@ -2,6 +2,7 @@ module;
 #include <vector>
 #include <variant>
 #include <bit>
+#include <cstddef>
 #include "Utility.hpp"
 export module Tako.HandleVec;
 
@@ -70,6 +71,18 @@ namespace tako
 			ASSERT(std::holds_alternative<T>(entry.value));
 			return *std::get_if<T>(&entry.value);
 		}
+
+		// Null if the handle was removed, also after its slot got reused
+		T* TryGet(const Handle& handle)
+		{
+			GenHandle h = std::bit_cast<GenHandle>(handle.value);
+			if (h.index == 0 || h.index > m_data.size())
+			{
+				return nullptr;
+			}
+			auto& entry = m_data[h.index - 1];
+			return entry.gen == h.gen ? std::get_if<T>(&entry.value) : nullptr;
+		}
 	private:
 		std::vector<Entry<T>> m_data;
 		U32 m_freeHandle = 0;
@@ -90,4 +103,118 @@ namespace tako
 			return m_data[handle.index - 1];
 		}
 	};
+
+	// Same handles as HandleVec, but values are kept packed for iteration.
+	// Removing swaps the last value into the gap, so references and iteration order don't survive it.
+	export template<Handle Handle, class T>
+	class SlotMap
+	{
+		struct Slot
+		{
+			// Position in the dense arrays while alive, next free slot otherwise
+			U32 index;
+			U32 gen = 0;
+		};
+	public:
+		Handle Insert(T&& item)
+		{
+			U32 denseIndex = static_cast<U32>(m_values.size());
+			m_values.push_back(std::forward<T>(item));
+
+			U32 slotIndex;
+			if (m_freeSlot)
+			{
+				slotIndex = m_freeSlot;
+				auto& slot = m_slots[slotIndex - 1];
+				m_freeSlot = slot.index;
+				slot.index = denseIndex;
+			}
+			else
+			{
+				m_slots.push_back({ denseIndex, 0 });
+				slotIndex = static_cast<U32>(m_slots.size());
+			}
+			m_denseToSlot.push_back(slotIndex);
+			return MakeHandle(slotIndex, m_slots[slotIndex - 1].gen);
+		}
+
+		void Remove(Handle handle)
+		{
+			GenHandle h = std::bit_cast<GenHandle>(handle.value);
+			auto& slot = GetSlot(h);
+			ASSERT(slot.gen == h.gen);
+
+			U32 denseIndex = slot.index;
+			U32 last = static_cast<U32>(m_values.size() - 1);
+			if (denseIndex != last)
+			{
+				m_values[denseIndex] = std::move(m_values[last]);
+				m_denseToSlot[denseIndex] = m_denseToSlot[last];
+				m_slots[m_denseToSlot[denseIndex] - 1].index = denseIndex;
+			}
+			m_values.pop_back();
+			m_denseToSlot.pop_back();
+
+			slot.index = m_freeSlot;
+			m_freeSlot = h.index;
+			++slot.gen;
+		}
+
+		bool Contains(const Handle& handle) const
+		{
+			GenHandle h = std::bit_cast<GenHandle>(handle.value);
+			return h.index > 0 && h.index - 1 < m_slots.size() && m_slots[h.index - 1].gen == h.gen;
+		}
+
+		T& operator[](const Handle& handle)
+		{
+			GenHandle h = std::bit_cast<GenHandle>(handle.value);
+			auto& slot = GetSlot(h);
+			ASSERT(slot.gen == h.gen);
+			return m_values[slot.index];
+		}
+
+		T* TryGet(const Handle& handle)
+		{
+			return Contains(handle) ? &m_values[m_slots[std::bit_cast<GenHandle>(handle.value).index - 1].index] : nullptr;
+		}
+
+		size_t size() const
+		{
+			return m_values.size();
+		}
+
+		// Handle of the value at a position of the dense iteration order
+		Handle GetHandle(size_t denseIndex) const
+		{
+			U32 slotIndex = m_denseToSlot[denseIndex];
+			return MakeHandle(slotIndex, m_slots[slotIndex - 1].gen);
+		}
+
+		auto begin() { return m_values.begin(); }
+		auto end() { return m_values.end(); }
+		auto begin() const { return m_values.begin(); }
+		auto end() const { return m_values.end(); }
+	private:
+		std::vector<T> m_values;
+		std::vector<U32> m_denseToSlot;
+		std::vector<Slot> m_slots;
+		U32 m_freeSlot = 0;
+
+		static Handle MakeHandle(const U32 index, const U32 gen)
+		{
+			GenHandle h;
+			h.index = index;
+			h.gen = gen;
+			Handle handle;
+			handle.value = std::bit_cast<U64>(h);
+			return handle;
+		}
+
+		Slot& GetSlot(const GenHandle& handle)
+		{
+			ASSERT(handle.index - 1 < m_slots.size());
+			return m_slots[handle.index - 1];
+		}
+	};
 }
@@ -7,24 +7,255 @@ module;
 #pragma pop_macro("constexpr")
 #include <string>
 #include <string_view>
+#include <cstring>
+#include <type_traits>
+#include <algorithm>
 export module Tako.Hash;
 
 import Tako.NumberTypes;
-import Tako.Reflection;
-import Tako.Serialization;
 
 namespace tako::Hash
 {
-	export U64 HashStr(std::string_view str)
+	export U64 HashBytes(const void* data, size_t size)
+	{
+		return rapidhash(data, size);
+	}
+
+	// Spreads the bits of integer keys, identity hashes like std::hash<int> don't work well with masking
+	export U64 HashInt(U64 value)
+	{
+		return rapid_mix(value ^ 0x9E3779B97F4A7C15ull, 0xD6E8FEB86659FD93ull);
+	}
+
+	export U64 Combine(U64 seed, U64 value)
 	{
-		return rapidhash(str.data(), str.size());
+		return rapid_mix(seed ^ 0x9E3779B97F4A7C15ull, value ^ 0xD6E8FEB86659FD93ull);
 	}
 
-	export template<Reflection::ReflectedType T>
-	U64 HashReflected(const T& t)
+	// The rapidhash header can't be evaluated at compile time, this is the rapidhash V1 algorithm written constexpr.
+	// Newer rapidhash versions hash differently, so HashStr uses it as well instead of the header.
+	namespace Detail
 	{
-		//TODO: do proper hashing instead of doing yaml
-		auto str = tako::Serialization::YAML::Serialize(t);
-		return HashStr(str);
+		constexpr U64 Seed = 0xbdd89aa982704029ull;
+		constexpr U64 Secret[3] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull };
+
+		constexpr void Mum(U64& a, U64& b)
+		{
+#ifdef __SIZEOF_INT128__
+			unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+			a = static_cast<U64>(r);
+			b = static_cast<U64>(r >> 64);
+#else
+			U64 ha = a >> 32, hb = b >> 32, la = static_cast<U32>(a), lb = static_cast<U32>(b);
+			U64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+			U64 c = t < rl;
+			U64 lo = t + (rm1 << 32);
+			c += lo < t;
+			a = lo;
+			b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+		}
+
+		constexpr U64 Mix(U64 a, U64 b)
+		{
+			Mum(a, b);
+			return a ^ b;
+		}
+
+		constexpr U64 Read(const char* p, size_t bytes)
+		{
+			if (!std::is_constant_evaluated())
+			{
+				U64 v = 0;
+				std::memcpy(&v, p, bytes);
+				return v;
+			}
+			U64 v = 0;
+			for (size_t i = 0; i < bytes; i++)
+			{
+				v |= U64(static_cast<U8>(p[i])) << (i * 8);
+			}
+			return v;
+		}
+
+		constexpr U64 Read64(const char* p)
+		{
+			return Read(p, 8);
+		}
+
+		constexpr U64 Read32(const char* p)
+		{
+			return Read(p, 4);
+		}
 	}
+
+	export constexpr U64 ConstHashStr(std::string_view str, U64 seed = Detail::Seed)
+	{
+		using namespace Detail;
+		const char* p = str.data();
+		size_t len = str.size();
+		seed ^= Mix(seed ^ Secret[0], Secret[1]) ^ len;
+		U64 a = 0;
+		U64 b = 0;
+		if (len <= 16)
+		{
+			if (len >= 4)
+			{
+				const char* last = p + len - 4;
+				size_t delta = (len & 24) >> (len >> 3);
+				a = (Read32(p) << 32) | Read32(last);
+				b = (Read32(p + delta) << 32) | Read32(last - delta);
+			}
+			else if (len > 0)
+			{
+				a = (U64(static_cast<U8>(p[0])) << 56) | (U64(static_cast<U8>(p[len >> 1])) << 32) | static_cast<U8>(p[len - 1]);
+			}
+		}
+		else
+		{
+			size_t i = len;
+			if (i > 48)
+			{
+				U64 see1 = seed;
+				U64 see2 = seed;
+				while (i >= 48)
+				{
+					seed = Mix(Read64(p) ^ Secret[0], Read64(p + 8) ^ seed);
+					see1 = Mix(Read64(p + 16) ^ Secret[1], Read64(p + 24) ^ see1);
+					see2 = Mix(Read64(p + 32) ^ Secret[2], Read64(p + 40) ^ see2);
+					p += 48;
+					i -= 48;
+				}
+				seed ^= see1 ^ see2;
+			}
+			if (i > 16)
+			{
+				seed = Mix(Read64(p) ^ Secret[2], Read64(p + 8) ^ seed ^ Secret[1]);
+				if (i > 32)
+				{
+					seed = Mix(Read64(p + 16) ^ Secret[2], Read64(p + 24) ^ seed);
+				}
+			}
+			a = Read64(p + i - 16);
+			b = Read64(p + i - 8);
+		}
+		a ^= Secret[1];
+		b ^= seed;
+		Mum(a, b);
+		return Mix(a ^ Secret[0] ^ len, b ^ Secret[1]);
+	}
+
+	// Same as ConstHashStr, so runtime hashes match "name"_id
+	export U64 HashStr(std::string_view str)
+	{
+		return ConstHashStr(str);
+	}
+
+	// Incremental rapidhash for data that isn't contiguous, fed in pieces without copying it together first.
+	// Uses the same block and tail mixing, but the length only goes in at the end,
+	// so the result differs from HashBytes over the same bytes.
+	export class Hasher
+	{
+	public:
+		Hasher(U64 seed = Detail::Seed)
+		{
+			m_seed = Detail::Mix(seed ^ Detail::Secret[0], Detail::Secret[1]) ^ seed;
+			m_see1 = m_seed;
+			m_see2 = m_seed;
+		}
+
+		void Update(const void* data, size_t size)
+		{
+			const U8* bytes = reinterpret_cast<const U8*>(data);
+			m_length += size;
+			while (size > 0)
+			{
+				// Blocks are only mixed once more data follows, the last one belongs to the tail
+				if (m_bufferSize == BlockSize)
+				{
+					MixBlock();
+				}
+				size_t count = std::min(size, BlockSize - m_bufferSize);
+				std::memcpy(m_buffer + TailSize + m_bufferSize, bytes, count);
+				m_bufferSize += count;
+				bytes += count;
+				size -= count;
+			}
+		}
+
+		template<typename T>
+			requires std::is_trivially_copyable_v<T>
+		void Add(const T& value)
+		{
+			Update(&value, sizeof(T));
+		}
+
+		U64 Finalize() const
+		{
+			using namespace Detail;
+			const char* p = reinterpret_cast<const char*>(m_buffer + TailSize);
+			size_t i = m_bufferSize;
+			U64 seed = m_seed;
+			U64 a = 0;
+			U64 b = 0;
+			if (m_length <= 16)
+			{
+				if (i >= 4)
+				{
+					const char* last = p + i - 4;
+					size_t delta = (i & 24) >> (i >> 3);
+					a = (Read32(p) << 32) | Read32(last);
+					b = (Read32(p + delta) << 32) | Read32(last - delta);
+				}
+				else if (i > 0)
+				{
+					a = (U64(static_cast<U8>(p[0])) << 56) | (U64(static_cast<U8>(p[i >> 1])) << 32) | static_cast<U8>(p[i - 1]);
+				}
+			}
+			else
+			{
+				if (m_length > BlockSize)
+				{
+					seed ^= m_see1 ^ m_see2;
+				}
+				if (i > 16)
+				{
+					seed = Mix(Read64(p) ^ Secret[2], Read64(p + 8) ^ seed ^ Secret[1]);
+					if (i > 32)
+					{
+						seed = Mix(Read64(p + 16) ^ Secret[2], Read64(p + 24) ^ seed);
+					}
+				}
+				// Short tails reach back into the end of the previous block
+				a = Read64(p + i - 16);
+				b = Read64(p + i - 8);
+			}
+			a ^= Secret[1];
+			b ^= seed;
+			Mum(a, b);
+			return Mix(a ^ Secret[0] ^ m_length, b ^ Secret[1]);
+		}
+	private:
+		static constexpr size_t BlockSize = 48;
+		static constexpr size_t TailSize = 16;
+
+		void MixBlock()
+		{
+			using namespace Detail;
+			const char* p = reinterpret_cast<const char*>(m_buffer + TailSize);
+			m_seed = Mix(Read64(p) ^ Secret[0], Read64(p + 8) ^ m_seed);
+			m_see1 = Mix(Read64(p + 16) ^ Secret[1], Read64(p + 24) ^ m_see1);
+			m_see2 = Mix(Read64(p + 32) ^ Secret[2], Read64(p + 40) ^ m_see2);
+			std::memcpy(m_buffer, m_buffer + BlockSize, TailSize);
+			m_bufferSize = 0;
+		}
+
+		U64 m_seed;
+		U64 m_see1;
+		U64 m_see2;
+		U64 m_length = 0;
+		size_t m_bufferSize = 0;
+		// The last 16 bytes of the previous block, followed by the current one
+		U8 m_buffer[TailSize + BlockSize] = {};
+	};
 }
@@ -0,0 +1,103 @@
+module;
+#include <string>
+#include <vector>
+#include <memory>
+export module Tako.Hash.Reflection;
+
+import Tako.NumberTypes;
+import Tako.Hash;
+import Tako.Reflection;
+
+namespace tako::Hash
+{
+	export void HashReflected(Hasher& hasher, const void* data, const Reflection::TypeInformation* info);
+
+	// Structural hash over the reflected fields, equal objects hash equal regardless of padding or heap layout.
+	// Floats are hashed bitwise, so 0.0 and -0.0 differ.
+	export template<Reflection::ReflectedType T>
+	U64 HashReflected(const T& t)
+	{
+		Hasher hasher;
+		HashReflected(hasher, &t, Reflection::Resolver::Get<T>());
+		return hasher.Finalize();
+	}
+
+	void HashPrimitive(Hasher& hasher, const void* data, const Reflection::PrimitiveInformation* info)
+	{
+		if (info->IsType<std::string>())
+		{
+			auto& str = *reinterpret_cast<const std::string*>(data);
+			hasher.Add(str.size());
+			hasher.Update(str.data(), str.size());
+			return;
+		}
+		hasher.Update(data, info->size);
+	}
+
+	void HashEnum(Hasher& hasher, const void* data, const Reflection::EnumInformation* info)
+	{
+		hasher.Add(info->convertUnderlying(data));
+	}
+
+	void HashStruct(Hasher& hasher, const void* data, const Reflection::StructInformation* info)
+	{
+		for (auto& field : info->fields)
+		{
+			HashReflected(hasher, reinterpret_cast<const U8*>(data) + field.offset, field.type);
+		}
+	}
+
+	void HashArray(Hasher& hasher, const void* data, const Reflection::ArrayInformation* info)
+	{
+		auto size = info->GetSize(data);
+		auto arrData = reinterpret_cast<const U8*>(info->GetData(data));
+		auto elementType = info->elementType;
+		hasher.Add(size);
+		// Plain primitives are contiguous without padding, feed them in one go
+		if (elementType->kind == Reflection::TypeKind::Primitive && !elementType->IsType<std::string>())
+		{
+			hasher.Update(arrData, size * elementType->size);
+			return;
+		}
+		for (size_t i = 0; i < size; ++i)
+		{
+			HashReflected(hasher, arrData + i * elementType->size, elementType);
+		}
+	}
+
+	void HashPoly(Hasher& hasher, const void* data, const Reflection::PolymorphicInformation* info)
+	{
+		auto ptr = static_cast<const std::unique_ptr<void>*>(data)->get();
+		auto elementInfo = ptr ? info->GetDerivedInfo(data) : nullptr;
+		if (elementInfo == nullptr)
+		{
+			hasher.Add(U64(0));
+			return;
+		}
+		// The type name, since the same fields can mean different things in different subclasses
+		hasher.Add(ConstHashStr(elementInfo->name));
+		HashReflected(hasher, ptr, elementInfo);
+	}
+
+	void HashReflected(Hasher& hasher, const void* data, const Reflection::TypeInformation* info)
+	{
+		switch (info->kind)
+		{
+		case Reflection::TypeKind::Struct:
+			HashStruct(hasher, data, reinterpret_cast<const Reflection::StructInformation*>(info));
+			break;
+		case Reflection::TypeKind::Array:
+			HashArray(hasher, data, reinterpret_cast<const Reflection::ArrayInformation*>(info));
+			break;
+		case Reflection::TypeKind::Primitive:
+			HashPrimitive(hasher, data, reinterpret_cast<const Reflection::PrimitiveInformation*>(info));
+			break;
+		case Reflection::TypeKind::Enum:
+			HashEnum(hasher, data, reinterpret_cast<const Reflection::EnumInformation*>(info));
+			break;
+		case Reflection::TypeKind::Polymorphic:
+			HashPoly(hasher, data, reinterpret_cast<const Reflection::PolymorphicInformation*>(info));
+			break;
+		}
+	}
+}
@@ -1,5 +1,8 @@
 module;
 #include "Utility.hpp"
+#include <span>
+#include <memory>
+#include <cstdint>
 export module Tako.IO;
 
 import Tako.NumberTypes;
@@ -26,6 +29,228 @@ namespace tako::IO
         Current = SEEK_CUR,
         End = SEEK_END
     };
+    // Returns false if the position couldn't be set
     export bool Seek(FileHandle* file, long offset, SeekOrigin origin);
     export size_t Tell(FileHandle* file);
+
+    // Reads at an absolute offset without using or moving the position of the handle,
+    // so several threads can read the same file at once. Returns less than size only at the end of the file.
+    export size_t ReadAt(FileHandle* file, U64 offset, U8* buffer, size_t size);
+
+	export class MappedFile;
+	export class StreamReader;
+
+	// Returns an invalid view if the file can't be opened
+	export MappedFile Map(StringView filePath);
+
+	// Read-only view of a whole file, unmapped when it goes out of scope.
+	// Memory mapped on Linux and macOS, elsewhere the file is read into a buffer owned by the view.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+
+		~MappedFile()
+		{
+			Release();
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& other) noexcept
+		{
+			TakeFrom(other);
+		}
+
+		MappedFile& operator=(MappedFile&& other) noexcept
+		{
+			if (this != &other)
+			{
+				Release();
+				TakeFrom(other);
+			}
+			return *this;
+		}
+
+		// Doesn't own the memory, the caller keeps it alive for as long as the view
+		static MappedFile FromView(std::span<const U8> data)
+		{
+			MappedFile file;
+			file.m_data = data.data();
+			file.m_size = data.size();
+			file.m_storage = Storage::Borrowed;
+			return file;
+		}
+
+		static MappedFile FromBuffer(std::unique_ptr<U8[]> data, size_t size)
+		{
+			MappedFile file;
+			file.m_data = data.release();
+			file.m_size = size;
+			file.m_storage = Storage::Owned;
+			return file;
+		}
+
+		const U8* GetData() const
+		{
+			return m_data;
+		}
+
+		size_t GetSize() const
+		{
+			return m_size;
+		}
+
+		std::span<const U8> AsSpan() const
+		{
+			return { m_data, m_size };
+		}
+
+		bool IsValid() const
+		{
+			return m_storage != Storage::None;
+		}
+
+		// False if the data had to be copied, e.g. by the platform fallback or decompression
+		bool IsMapped() const
+		{
+			return m_storage == Storage::Mapped;
+		}
+	private:
+		enum class Storage
+		{
+			None,
+			Empty,
+			Mapped,
+			Owned,
+			Borrowed
+		};
+
+		const U8* m_data = nullptr;
+		size_t m_size = 0;
+		Storage m_storage = Storage::None;
+
+		void Release();
+
+		void TakeFrom(MappedFile& other)
+		{
+			m_data = other.m_data;
+			m_size = other.m_size;
+			m_storage = other.m_storage;
+			other.m_data = nullptr;
+			other.m_size = 0;
+			other.m_storage = Storage::None;
+		}
+
+		friend MappedFile Map(StringView filePath);
+	};
+	export constexpr size_t DefaultStreamBufferSize = 1 << 20;
+
+	// Memory mapped where Map maps, otherwise read through a buffer of bufferSize bytes
+	export StreamReader OpenStream(StringView filePath, size_t bufferSize = DefaultStreamBufferSize);
+
+	// Front to back reads that hand out windows into a mapping or an internal buffer instead of copying into the caller's memory.
+	// A window stays valid until the next call on the reader.
+	class StreamReader
+	{
+	public:
+		StreamReader() = default;
+
+		~StreamReader()
+		{
+			if (m_file)
+			{
+				Close(m_file);
+			}
+		}
+
+		StreamReader(const StreamReader&) = delete;
+		StreamReader& operator=(const StreamReader&) = delete;
+
+		StreamReader(StreamReader&& other) noexcept
+		{
+			TakeFrom(other);
+		}
+
+		StreamReader& operator=(StreamReader&& other) noexcept
+		{
+			if (this != &other)
+			{
+				if (m_file)
+				{
+					Close(m_file);
+				}
+				TakeFrom(other);
+			}
+			return *this;
+		}
+
+		static StreamReader FromMapped(MappedFile file)
+		{
+			StreamReader reader;
+			reader.m_mapped = std::move(file);
+			return reader;
+		}
+
+		// Takes ownership of the handle, reads go through ReadAt so the handle position isn't used
+		static StreamReader FromHandle(FileHandle* file, size_t bufferSize = DefaultStreamBufferSize)
+		{
+			StreamReader reader;
+			reader.m_file = file;
+			reader.m_capacity = bufferSize;
+			reader.m_buffer.reset(new U8[bufferSize]);
+			return reader;
+		}
+
+		bool IsValid() const
+		{
+			return m_file || m_mapped.IsValid();
+		}
+
+		// Exactly size bytes unless the file ends first. Buffered readers return at most their buffer size.
+		std::span<const U8> Read(size_t size);
+
+		// Whatever is available without moving or refilling the buffer, at most maxSize bytes and empty at the end
+		std::span<const U8> ReadChunk(size_t maxSize = SIZE_MAX);
+
+		void Skip(U64 count);
+
+		U64 Tell() const
+		{
+			return m_file ? m_fileOffset - (m_end - m_begin) : m_position;
+		}
+
+		bool AtEnd();
+	private:
+		MappedFile m_mapped;
+		U64 m_position = 0;
+
+		FileHandle* m_file = nullptr;
+		std::unique_ptr<U8[]> m_buffer;
+		size_t m_capacity = 0;
+		// Unread part of the buffer
+		size_t m_begin = 0;
+		size_t m_end = 0;
+		// File offset of the first byte behind the buffered data
+		U64 m_fileOffset = 0;
+		bool m_eof = false;
+
+		// Moves the unread bytes to the front and reads until the buffer is full or the file ends
+		void Fill();
+
+		void TakeFrom(StreamReader& other)
+		{
+			m_mapped = std::move(other.m_mapped);
+			m_position = other.m_position;
+			m_file = other.m_file;
+			m_buffer = std::move(other.m_buffer);
+			m_capacity = other.m_capacity;
+			m_begin = other.m_begin;
+			m_end = other.m_end;
+			m_fileOffset = other.m_fileOffset;
+			m_eof = other.m_eof;
+			other.m_file = nullptr;
+		}
+	};
 }
\ No newline at end of file
@@ -0,0 +1,126 @@
+module;
+#include "Utility.hpp"
+#include <vector>
+#include <deque>
+#include <span>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+export module Tako.IOQueue;
+
+import Tako.JobSystem;
+
+namespace tako
+{
+	// Dedicated threads for blocking file reads, so they don't occupy JobSystem workers.
+	// Work is started in submission order, the latch is counted down once per finished item.
+	export class IOQueue
+	{
+	public:
+		using Work = std::function<void()>;
+
+		explicit IOQueue(unsigned int threadCount = 2) : m_threadCount(std::max(threadCount, 1u))
+		{
+		}
+
+		IOQueue(const IOQueue&) = delete;
+		IOQueue& operator=(const IOQueue&) = delete;
+
+		~IOQueue()
+		{
+			{
+				std::lock_guard lock(m_mutex);
+				m_stop = true;
+			}
+			m_cv.notify_all();
+			for (auto& thread : m_threads)
+			{
+				thread.join();
+			}
+		}
+
+		void Submit(Work work, AsyncLatch& latch)
+		{
+			Submit(std::span<Work>(&work, 1), latch);
+		}
+
+		// Queues the whole batch under one lock, latch has to be created with the batch size
+		void Submit(std::span<Work> batch, AsyncLatch& latch)
+		{
+#ifdef TAKO_EMSCRIPTEN
+			// Filesystem calls from a pthread are proxied to the main thread, which is busy running jobs
+			for (auto& work : batch)
+			{
+				work();
+				latch.CountDown();
+			}
+#else
+			{
+				std::lock_guard lock(m_mutex);
+				StartThreads();
+				for (auto& work : batch)
+				{
+					m_queue.push_back({ std::move(work), &latch });
+				}
+			}
+			if (batch.size() == 1)
+			{
+				m_cv.notify_one();
+			}
+			else
+			{
+				m_cv.notify_all();
+			}
+#endif
+		}
+	private:
+		struct Request
+		{
+			Work work;
+			AsyncLatch* latch = nullptr;
+		};
+
+		unsigned int m_threadCount;
+		std::vector<std::thread> m_threads;
+		std::deque<Request> m_queue;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		bool m_stop = false;
+
+		// Started on first use, most runs never load anything asynchronously
+		void StartThreads()
+		{
+			if (!m_threads.empty())
+			{
+				return;
+			}
+			LOG("Starting {} IO threads", m_threadCount);
+			for (unsigned int i = 0; i < m_threadCount; i++)
+			{
+				m_threads.emplace_back(&IOQueue::WorkerThread, this);
+			}
+		}
+
+		void WorkerThread()
+		{
+			while (true)
+			{
+				Request request;
+				{
+					std::unique_lock lock(m_mutex);
+					m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+					if (m_queue.empty())
+					{
+						return;
+					}
+					request = std::move(m_queue.front());
+					m_queue.pop_front();
+				}
+				request.work();
+				request.latch->CountDown();
+			}
+		}
+	};
+}
@@ -3,6 +3,7 @@ module;
 export module Tako.ImGui;
 
 import Tako.InputEvent;
+import Tako.Allocators.TrackingAllocator;
 
 namespace tako
 {
@@ -25,4 +26,64 @@ namespace tako
 			}
 		}
 	};
-}
\ No newline at end of file
+
+	// Lists every registered AllocationTag, budget overflows are highlighted
+	export void ShowAllocationStatsWindow(bool* open = nullptr)
+	{
+		if (!ImGui::Begin("Allocations", open))
+		{
+			ImGui::End();
+			return;
+		}
+
+		constexpr auto flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+		if (ImGui::BeginTable("AllocationStats", 7, flags))
+		{
+			ImGui::TableSetupColumn("Tag");
+			ImGui::TableSetupColumn("Current (KB)");
+			ImGui::TableSetupColumn("Peak (KB)");
+			ImGui::TableSetupColumn("Budget (KB)");
+			ImGui::TableSetupColumn("Live");
+			ImGui::TableSetupColumn("Total");
+			ImGui::TableSetupColumn("Overflows");
+			ImGui::TableHeadersRow();
+
+			for (auto& stats : Allocators::AllocationTag::GetAllStats())
+			{
+				bool overflow = stats.overflows > 0 || stats.failedAllocations > 0;
+				if (overflow)
+				{
+					ImGui::PushStyleColor(ImGuiCol_Text, IM_COL32(255, 96, 96, 255));
+				}
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(stats.name);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", stats.currentBytes / 1024.0);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", stats.peakBytes / 1024.0);
+				ImGui::TableNextColumn();
+				if (stats.budget > 0)
+				{
+					ImGui::Text("%.1f", stats.budget / 1024.0);
+				}
+				else
+				{
+					ImGui::TextUnformatted("-");
+				}
+				ImGui::TableNextColumn();
+				ImGui::Text("%zu", stats.liveAllocations);
+				ImGui::TableNextColumn();
+				ImGui::Text("%zu", stats.totalAllocations);
+				ImGui::TableNextColumn();
+				ImGui::Text("%zu", stats.overflows + stats.failedAllocations);
+				if (overflow)
+				{
+					ImGui::PopStyleColor();
+				}
+			}
+			ImGui::EndTable();
+		}
+		ImGui::End();
+	}
+}
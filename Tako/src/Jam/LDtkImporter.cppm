@@ -1,4 +1,6 @@
 module;
+#include "Utility.hpp"
+#include "NumberTypes.hpp"
 #include <nlohmann/json.hpp>
 export module Tako.LDtkImporter;
 
@@ -6,6 +8,7 @@ import Tako.Math;
 import Tako.TileMap;
 import Tako.Assets;
 import Tako.Bitmap;
+import Tako.IO;
 
 export namespace tako::Jam::LDtkImporter
 {
@@ -17,7 +20,17 @@ export namespace tako::Jam::LDtkImporter
 	};
 	TileWorld LoadWorld(const char* projectFile)
 	{
-		auto json = nlohmann::json::parse(Assets::ReadAssetText(projectFile));
+		nlohmann::json json;
+		{
+			// The raw project file is only needed while parsing
+			auto file = IO::Map(Assets::GetAssetPath(projectFile));
+			if (!file.IsValid())
+			{
+				LOG_ERR("Could not read LDtk project {}", projectFile);
+				return {};
+			}
+			json = nlohmann::json::parse(file.GetData(), file.GetData() + file.GetSize());
+		}
 
 		auto& tileSets = json["defs"]["tilesets"];
 
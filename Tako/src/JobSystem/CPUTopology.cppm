@@ -0,0 +1,206 @@
+module;
+#include "Utility.hpp"
+#include <vector>
+#include <span>
+#include <string>
+#include <string_view>
+#include <cctype>
+#include <thread>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#ifdef TAKO_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+#ifdef TAKO_WINDOWS
+#define NOMINMAX
+#include <windows.h>
+#endif
+export module Tako.JobSystem.CPUTopology;
+
+namespace tako
+{
+	export struct NumaNode
+	{
+		unsigned int id;
+		std::vector<unsigned int> cores;
+	};
+
+	export class CPUTopology
+	{
+	public:
+		static CPUTopology Query()
+		{
+			CPUTopology topology;
+			topology.QueryPlatform();
+			if (topology.m_nodes.empty())
+			{
+				NumaNode node;
+				node.id = 0;
+				unsigned int coreCount = std::max(1u, std::thread::hardware_concurrency());
+				for (unsigned int i = 0; i < coreCount; i++)
+				{
+					node.cores.push_back(i);
+				}
+				topology.m_nodes.push_back(std::move(node));
+			}
+			return topology;
+		}
+
+		std::span<const NumaNode> GetNodes() const
+		{
+			return m_nodes;
+		}
+
+		size_t GetCoreCount() const
+		{
+			size_t count = 0;
+			for (auto& node : m_nodes)
+			{
+				count += node.cores.size();
+			}
+			return count;
+		}
+
+		// Cores ordered either node by node, or in the order the OS numbers them
+		std::vector<unsigned int> GetCoreOrder(bool groupByNode) const
+		{
+			std::vector<unsigned int> cores;
+			for (auto& node : m_nodes)
+			{
+				cores.insert(cores.end(), node.cores.begin(), node.cores.end());
+			}
+			if (!groupByNode)
+			{
+				std::sort(cores.begin(), cores.end());
+			}
+			return cores;
+		}
+
+		unsigned int GetNodeOfCore(unsigned int core) const
+		{
+			for (auto& node : m_nodes)
+			{
+				if (std::find(node.cores.begin(), node.cores.end(), core) != node.cores.end())
+				{
+					return node.id;
+				}
+			}
+			return 0;
+		}
+
+		static bool PinCurrentThread(unsigned int core)
+		{
+#if defined(TAKO_LINUX)
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET(core, &set);
+			return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(TAKO_WINDOWS)
+			if (core >= sizeof(DWORD_PTR) * 8)
+			{
+				return false;
+			}
+			return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core) != 0;
+#else
+			return false;
+#endif
+		}
+	private:
+		std::vector<NumaNode> m_nodes;
+
+		void QueryPlatform()
+		{
+#if defined(TAKO_LINUX)
+			cpu_set_t allowed;
+			CPU_ZERO(&allowed);
+			bool hasAllowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+			std::error_code ec;
+			for (auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec))
+			{
+				auto name = entry.path().filename().string();
+				if (!name.starts_with("node") || name.size() <= 4 || !std::isdigit(name[4]))
+				{
+					continue;
+				}
+
+				NumaNode node;
+				node.id = std::stoul(name.substr(4));
+				std::ifstream cpuList(entry.path() / "cpulist");
+				std::string list;
+				std::getline(cpuList, list);
+				for (auto core : ParseCPUList(list))
+				{
+					if (!hasAllowed || CPU_ISSET(core, &allowed))
+					{
+						node.cores.push_back(core);
+					}
+				}
+				if (!node.cores.empty())
+				{
+					m_nodes.push_back(std::move(node));
+				}
+			}
+			std::sort(m_nodes.begin(), m_nodes.end(), [](const NumaNode& a, const NumaNode& b) { return a.id < b.id; });
+#elif defined(TAKO_WINDOWS)
+			ULONG highestNode = 0;
+			if (!GetNumaHighestNodeNumber(&highestNode))
+			{
+				return;
+			}
+			for (USHORT i = 0; i <= highestNode; i++)
+			{
+				GROUP_AFFINITY affinity;
+				if (!GetNumaNodeProcessorMaskEx(i, &affinity) || affinity.Group != 0)
+				{
+					// Only the first processor group is supported for now
+					continue;
+				}
+				NumaNode node;
+				node.id = i;
+				for (unsigned int core = 0; core < sizeof(affinity.Mask) * 8; core++)
+				{
+					if (affinity.Mask & (KAFFINITY(1) << core))
+					{
+						node.cores.push_back(core);
+					}
+				}
+				if (!node.cores.empty())
+				{
+					m_nodes.push_back(std::move(node));
+				}
+			}
+#endif
+		}
+
+		// Parses lists in the form of "0-3,8,10-11"
+		static std::vector<unsigned int> ParseCPUList(std::string_view list)
+		{
+			std::vector<unsigned int> cores;
+			size_t pos = 0;
+			while (pos < list.size())
+			{
+				size_t end = list.find(',', pos);
+				if (end == std::string_view::npos)
+				{
+					end = list.size();
+				}
+				auto range = list.substr(pos, end - pos);
+				if (!range.empty())
+				{
+					auto dash = range.find('-');
+					unsigned int first = std::stoul(std::string(range.substr(0, dash)));
+					unsigned int last = dash == std::string_view::npos ? first : std::stoul(std::string(range.substr(dash + 1)));
+					for (unsigned int core = first; core <= last; core++)
+					{
+						cores.push_back(core);
+					}
+				}
+				pos = end + 1;
+			}
+			return cores;
+		}
+	};
+}
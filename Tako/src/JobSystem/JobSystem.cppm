@@ -1,13 +1,19 @@
 module;
 #include "Utility.hpp"
 #include <vector>
+#include <array>
+#include <span>
+#include <cstdint>
 #include <thread>
 #include <atomic>
 #include <optional>
 #include <coroutine>
 #include <queue>
+#include <deque>
+#include <cstddef>
 #include <mutex>
 #include <condition_variable>
+#include <algorithm>
 #ifdef EMSCRIPTEN
 #include <emscripten.h>
 #endif
@@ -15,12 +21,26 @@ export module Tako.JobSystem;
 
 import Tako.Allocators.FreeListAllocator;
 import Tako.Allocators.PoolAllocator;
+import Tako.JobSystem.CPUTopology;
+import Tako.Trace;
 
 
 namespace tako
 {
 	export class JobSystem;
 
+	export struct JobSystemConfig
+	{
+		// Worker threads started in addition to the main thread, 0 picks one per available core
+		unsigned int workerCount = 0;
+		// Cores left to other processes, reducing the default worker count and excluded from pinning
+		unsigned int reservedCores = 0;
+		// Pin the main thread and every worker to its own core, workers without a free core aren't started
+		bool pinThreads = false;
+		// When pinning, fill up one NUMA node after another instead of following the OS core numbering
+		bool groupByNumaNode = false;
+	};
+
 	template<typename R, bool IsVoid = std::is_same_v<void, R>>
 	struct PromiseBase;
 
@@ -44,6 +64,31 @@ namespace tako
 	export template<typename R>
 	class Task;
 
+	class Job;
+
+	// Shared completion state for WhenAll/WhenAny, lives inside the awaiter of the waiting task
+	class TaskGroup
+	{
+		friend Job;
+	protected:
+		TaskGroup(bool waitForAll, size_t pending) : m_waitForAll(waitForAll), m_pending(pending) {}
+
+		void BeginSuspend();
+		bool Attach(Job* member);
+		bool Detach(Job* member);
+		bool Register(size_t finishedMembers);
+		void WaitForDetached();
+	private:
+		Job* m_waiter = nullptr;
+		const bool m_waitForAll;
+		// Members (or the first member for WhenAny) left to finish, +1 held by the waiter until it's suspended
+		std::atomic<size_t> m_pending;
+		std::atomic<size_t> m_attached = 0;
+		std::atomic<bool> m_triggered = false;
+
+		void OnMemberFinished();
+	};
+
 	struct InitialTaskAwaiter
 	{
 		constexpr bool await_ready() const noexcept { return false; }
@@ -61,10 +106,15 @@ namespace tako
 		std::suspend_always final_suspend() noexcept
 		{
 			task->m_done = true;
-			if (task->m_parent)
+#ifdef TAKO_TRACE
+			Job::m_traceFinished = true;
+#endif
+			if (!task->NotifyGroupFinished() && task->m_parent)
 			{
 				task->m_parent->OnChildFinished(task);
 			}
+			// Last access to the task, detached tasks may be deleted by their owner from here on
+			task->m_released.store(true, std::memory_order_release);
 			return {};
 		}
 
@@ -81,6 +131,7 @@ namespace tako
 	class Job
 	{
 		friend JobSystem;
+		friend TaskGroup;
 		template<typename R>
 		friend struct TaskAwaiter;
 		template<typename R>
@@ -93,6 +144,30 @@ namespace tako
 		virtual void OnChildFinished(Job* child) = 0;
 
 		Job* m_parent = nullptr;
+		std::atomic<TaskGroup*> m_group = nullptr;
+#ifdef TAKO_TRACE
+		const char* m_traceName = "Task";
+		bool m_traceStarted = false;
+		// Set by the final suspend of the job running on this thread
+		static inline thread_local bool m_traceFinished = false;
+#endif
+
+		static TaskGroup* FinishedMarker()
+		{
+			return reinterpret_cast<TaskGroup*>(std::uintptr_t(1));
+		}
+
+		// Returns true if a group took over the completion notification instead of the parent
+		bool NotifyGroupFinished()
+		{
+			auto group = m_group.exchange(FinishedMarker());
+			if (group == nullptr)
+			{
+				return false;
+			}
+			group->OnMemberFinished();
+			return true;
+		}
 	};
 
 	template<typename R = void>
@@ -154,6 +229,12 @@ namespace tako
 			return m_done;
 		}
 
+		// Done and past its final suspend, unlike Done it's safe to delete the task once this is true
+		bool Released() const
+		{
+			return m_released.load(std::memory_order_acquire);
+		}
+
 		auto GetResult()
 		{
 			if constexpr (!std::is_void_v<R>)
@@ -193,43 +274,336 @@ namespace tako
 	private:
 		std::atomic<bool> m_done = false;
 		std::atomic<bool> m_destroyed = false;
+		std::atomic<bool> m_released = false;
 		std::atomic<Job*> m_waitingFor = nullptr;
 		std::coroutine_handle<promise_type> m_handle;
 
 		void CheckRescheduleAfterAwait(Job* child);
 	};
 
+	inline Job* AsJob(Job* job)
+	{
+		return job;
+	}
+
+	inline Job* AsJob(Job& job)
+	{
+		return &job;
+	}
+
+	template<typename Members>
+	class WhenAllAwaiter : TaskGroup
+	{
+	public:
+		WhenAllAwaiter(Members members) : TaskGroup(true, std::size(members) + 1), m_members(members) {}
+
+		bool await_ready() const noexcept
+		{
+			for (auto& member : m_members)
+			{
+				if (!AsJob(member)->Done())
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			BeginSuspend();
+			size_t finished = 0;
+			for (auto& member : m_members)
+			{
+				if (!Attach(AsJob(member)))
+				{
+					finished++;
+				}
+			}
+			// Only suspend if there are still members running after registering
+			return !Register(finished);
+		}
+
+		void await_resume() const noexcept {}
+	private:
+		Members m_members;
+	};
+
+	template<typename Members>
+	class WhenAnyAwaiter : TaskGroup
+	{
+	public:
+		WhenAnyAwaiter(Members members) : TaskGroup(false, 2), m_members(members) {}
+
+		bool await_ready() const noexcept
+		{
+			// Nothing could ever finish, so there is nothing to wait for
+			if (std::empty(m_members))
+			{
+				return true;
+			}
+			for (auto& member : m_members)
+			{
+				if (AsJob(member)->Done())
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			BeginSuspend();
+			size_t finished = 0;
+			for (auto& member : m_members)
+			{
+				if (!Attach(AsJob(member)))
+				{
+					finished++;
+				}
+			}
+			return !Register(finished);
+		}
+
+		// Returns the index of a finished member, 0 (the end) if there are no members
+		size_t await_resume() noexcept
+		{
+			if (std::empty(m_members))
+			{
+				return 0;
+			}
+			// Members still running must not reference this awaiter after the waiter continues
+			for (auto& member : m_members)
+			{
+				Detach(AsJob(member));
+			}
+			WaitForDetached();
+
+			size_t index = 0;
+			for (auto& member : m_members)
+			{
+				if (AsJob(member)->Done())
+				{
+					return index;
+				}
+				index++;
+			}
+			ASSERT(false);
+			return index;
+		}
+	private:
+		Members m_members;
+	};
+
+	// Suspends until all tasks are done, rescheduling the waiting task only once
+	export template<typename... Rs>
+	WhenAllAwaiter<std::array<Job*, sizeof...(Rs)>> WhenAll(Task<Rs>&... tasks)
+	{
+		return WhenAllAwaiter<std::array<Job*, sizeof...(Rs)>>({ &tasks... });
+	}
+
+	export template<typename R>
+	WhenAllAwaiter<std::span<Task<R>>> WhenAll(std::span<Task<R>> tasks)
+	{
+		return WhenAllAwaiter<std::span<Task<R>>>(tasks);
+	}
+
+	// Suspends until the first task is done, returning its index.
+	// The remaining tasks keep running and still have to be awaited before they go out of scope.
+	// An empty span doesn't suspend and returns 0, which is its size
+	export template<typename... Rs>
+	WhenAnyAwaiter<std::array<Job*, sizeof...(Rs)>> WhenAny(Task<Rs>&... tasks)
+	{
+		return WhenAnyAwaiter<std::array<Job*, sizeof...(Rs)>>({ &tasks... });
+	}
+
+	export template<typename R>
+	WhenAnyAwaiter<std::span<Task<R>>> WhenAny(std::span<Task<R>> tasks)
+	{
+		return WhenAnyAwaiter<std::span<Task<R>>>(tasks);
+	}
+
+	// Awaitable countdown for work finishing outside the JobSystem, e.g. on an I/O thread.
+	// The awaiting task is rescheduled on the JobSystem once CountDown was called count times.
+	export class AsyncLatch
+	{
+	public:
+		explicit AsyncLatch(size_t count = 1) : m_count(count), m_state(count == 0 ? State::Done : State::Pending) {}
+
+		AsyncLatch(const AsyncLatch&) = delete;
+		AsyncLatch& operator=(const AsyncLatch&) = delete;
+
+		// Safe to call from any thread, the latch may be gone once the last call returns
+		void CountDown();
+
+		bool await_ready() const noexcept
+		{
+			return m_state.load(std::memory_order_acquire) == State::Done;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) noexcept;
+
+		void await_resume() const noexcept {}
+	private:
+		enum class State
+		{
+			Pending,
+			Waiting,
+			Done
+		};
+
+		std::atomic<size_t> m_count;
+		std::atomic<State> m_state;
+		Job* m_waiter = nullptr;
+	};
+
+	// Bounded lock-free queue for multiple producers and a single consumer
+	template<typename T, size_t Capacity>
+	class MPSCRing
+	{
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+	public:
+		MPSCRing()
+		{
+			for (size_t i = 0; i < Capacity; i++)
+			{
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		// Returns false if the ring is full
+		bool TryPush(T value)
+		{
+			size_t pos = m_head.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Cell& cell = m_cells[pos & (Capacity - 1)];
+				size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+				if (diff == 0)
+				{
+					if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					{
+						cell.value = value;
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				}
+				else if (diff < 0)
+				{
+					return false;
+				}
+				else
+				{
+					pos = m_head.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// Only to be called from the consumer thread
+		size_t PopBatch(T* out, size_t maxCount)
+		{
+			size_t count = 0;
+			while (count < maxCount)
+			{
+				Cell& cell = m_cells[m_tail & (Capacity - 1)];
+				if (cell.sequence.load(std::memory_order_acquire) != m_tail + 1)
+				{
+					break;
+				}
+				out[count++] = cell.value;
+				cell.sequence.store(m_tail + Capacity, std::memory_order_release);
+				m_tail++;
+			}
+			return count;
+		}
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T value;
+		};
+
+		Cell m_cells[Capacity];
+		alignas(64) std::atomic<size_t> m_head = 0;
+		alignas(64) size_t m_tail = 0;
+	};
+
 	class JobSystem
 	{
 		template<typename R>
 		friend class Task;
+		friend class TaskGroup;
+		friend class AsyncLatch;
 		friend struct InitialTaskAwaiter;
 	public:
 		JobSystem()
 		{
 		}
 
-		void Init()
+		void Init(const JobSystemConfig& config = {})
 		{
 			m_threadIndex = 0;
+			Trace::SetThreadIndex(0);
 #ifdef EMSCRIPTEN
-			m_threadCount = emscripten_run_script_int("navigator.hardwareConcurrency");
+			unsigned int hardwareThreads = emscripten_run_script_int("navigator.hardwareConcurrency");
 #else
-			m_threadCount = std::thread::hardware_concurrency();
+			unsigned int hardwareThreads = std::thread::hardware_concurrency();
 #endif
+			unsigned int workerTarget = config.workerCount;
+			if (workerTarget == 0)
+			{
+				unsigned int usedThreads = hardwareThreads > config.reservedCores ? hardwareThreads - config.reservedCores : 1;
+				workerTarget = std::max(usedThreads, 1u) - 1;
+			}
+			std::vector<unsigned int> cores;
+#ifndef EMSCRIPTEN
+			if (config.pinThreads)
+			{
+				m_topology = CPUTopology::Query();
+				cores = m_topology.GetCoreOrder(config.groupByNumaNode);
+				// Reserved cores are taken from the end, leaving them to other processes
+				size_t reserved = std::min<size_t>(config.reservedCores, cores.size() - 1);
+				cores.resize(cores.size() - reserved);
+				// Every thread gets a core of its own, threads sharing one would only get in each other's way
+				if (!cores.empty() && workerTarget + 1 > cores.size())
+				{
+					LOG_WARN("Only {} cores to pin to, reducing workers from {} to {}", cores.size(), workerTarget, cores.size() - 1);
+					workerTarget = static_cast<unsigned int>(cores.size() - 1);
+				}
+				LOG("Pinning threads to {} cores on {} NUMA nodes", cores.size(), m_topology.GetNodes().size());
+				PinThread(0, cores);
+			}
+#endif
+			m_threadCount = workerTarget + 1;
 			LOG("Threads: {}", m_threadCount);
 
-			int workerTarget = m_threadCount - 1;
 			m_workers.resize(workerTarget);
 			for (unsigned int i = 0; i < workerTarget; i++)
 			{
 				int threadIndex = i + 1;
 				LOG("Creating Thread: {}", threadIndex);
-				std::thread& thread = m_workers[i] = std::thread(&JobSystem::WorkerThread, this, threadIndex);
+				std::thread& thread = m_workers[i] = std::thread(&JobSystem::WorkerThread, this, threadIndex, cores);
 				thread.detach();
 			}
 		}
 
+		static unsigned int GetThreadIndex()
+		{
+			return m_threadIndex;
+		}
+
+		static unsigned int GetThreadCount()
+		{
+			return m_threadCount;
+		}
+
+		static unsigned int GetThreadNumaNode()
+		{
+			return m_numaNode;
+		}
+
 		void Stop()
 		{
 			m_stop = true;
@@ -243,26 +617,13 @@ namespace tako
 			ASSERT(mainJob == &mainTask);
 			m_started = true;
 			m_started.notify_all();
-			mainJob->Run();
+			RunTraced(mainJob);
 			m_runningJob = nullptr;
 			while (!m_stop && !mainJob->Done())
 			{
+				if (RunMainThreadJobs())
 				{
-					Job* job = nullptr;
-					bool moreMainThreadJobs = false;
-					{
-						std::lock_guard<std::mutex> lock(m_mainThreadQueueMutex);
-						if (!m_mainThreadQueue.empty())
-						{
-							job = m_mainThreadQueue.front();
-							m_mainThreadQueue.pop_front();
-						}
-					}
-					RunJob(job);
-					if (job)
-					{
-						continue;
-					}
+					continue;
 				}
 
 				Job* job  = nullptr;
@@ -291,24 +652,58 @@ namespace tako
 		{
 			m_scheduleNextTaskOnMain = true;
 		}
+
+		// The next task created on this thread won't notify the running task when it finishes,
+		// for background work that may outlive its creator. The Task object has to be kept alive elsewhere.
+		static void DetachNextTask()
+		{
+			m_detachNextTask = true;
+		}
+
+		// Name shown for the next task created on this thread when tracing, has to outlive the trace
+		static void SetNextTaskName(const char* name)
+		{
+#ifdef TAKO_TRACE
+			m_nextTaskName = name;
+#endif
+		}
 	private:
 		std::vector<std::thread> m_workers;
 		std::atomic<bool> m_started = false;
 		std::atomic<bool> m_stop = false;
 
 		static inline thread_local unsigned int m_threadIndex;
+		static inline thread_local unsigned int m_numaNode = 0;
 		static inline unsigned int m_threadCount;
+		CPUTopology m_topology;
 		static inline std::deque<Job*> m_globalQueue;
 		static inline std::mutex m_globalQueueMutex;
 		static inline std::condition_variable m_globalCV;
-		static inline std::deque<Job*> m_mainThreadQueue;
-		static inline std::mutex m_mainThreadQueueMutex;
+		static constexpr size_t MainThreadQueueCapacity = 1024;
+		static constexpr size_t MainThreadBatchSize = 32;
+		static inline MPSCRing<Job*, MainThreadQueueCapacity> m_mainThreadQueue;
+		// Used when the ring is full, and for every job after that until it is empty again
+		static inline std::deque<Job*> m_mainThreadOverflow;
+		static inline std::mutex m_mainThreadOverflowMutex;
+		static inline std::atomic<bool> m_hasMainThreadOverflow = false;
 		static inline thread_local Job* m_runningJob = nullptr;
 		static inline thread_local bool m_scheduleNextTaskOnMain = false;
+		static inline thread_local bool m_detachNextTask = false;
+#ifdef TAKO_TRACE
+		static inline thread_local const char* m_nextTaskName = nullptr;
+#endif
 
 		static void ScheduleJob(Job* job)
 		{
-			job->m_parent = JobSystem::m_runningJob;
+			job->m_parent = m_detachNextTask ? nullptr : JobSystem::m_runningJob;
+			m_detachNextTask = false;
+#ifdef TAKO_TRACE
+			if (m_nextTaskName)
+			{
+				job->m_traceName = m_nextTaskName;
+				m_nextTaskName = nullptr;
+			}
+#endif
 			ReScheduleJob(job);
 		}
 
@@ -335,15 +730,47 @@ namespace tako
 			m_globalCV.notify_one();
 		}
 
+		// Once the ring overflowed, later jobs queue up behind the overflow until it drained, so they still run in order
 		static void PushMainThreadJob(Job* job)
 		{
-			std::lock_guard<std::mutex> lock(m_mainThreadQueueMutex);
-			m_mainThreadQueue.push_back(job);
+			if (!m_hasMainThreadOverflow && m_mainThreadQueue.TryPush(job))
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(m_mainThreadOverflowMutex);
+			m_mainThreadOverflow.push_back(job);
+			m_hasMainThreadOverflow = true;
 		}
 
-		void WorkerThread(unsigned int threadIndex)
+		// Runs a batch of main thread jobs, returns false if there were none
+		bool RunMainThreadJobs()
+		{
+			std::array<Job*, MainThreadBatchSize> batch;
+			size_t count = m_mainThreadQueue.PopBatch(batch.data(), batch.size());
+			if (count == 0 && m_hasMainThreadOverflow)
+			{
+				std::lock_guard<std::mutex> lock(m_mainThreadOverflowMutex);
+				while (count < batch.size() && !m_mainThreadOverflow.empty())
+				{
+					batch[count++] = m_mainThreadOverflow.front();
+					m_mainThreadOverflow.pop_front();
+				}
+				m_hasMainThreadOverflow = !m_mainThreadOverflow.empty();
+			}
+
+			for (size_t i = 0; i < count; i++)
+			{
+				RunJob(batch[i]);
+			}
+			return count > 0;
+		}
+
+		void WorkerThread(unsigned int threadIndex, std::vector<unsigned int> cores)
 		{
 			m_threadIndex = threadIndex;
+			Trace::SetThreadIndex(threadIndex);
+			PinThread(threadIndex, cores);
 			m_started.wait(false);
 			while (!m_stop)
 			{
@@ -352,6 +779,20 @@ namespace tako
 			}
 		}
 
+		void PinThread(unsigned int threadIndex, const std::vector<unsigned int>& cores)
+		{
+			if (cores.empty())
+			{
+				return;
+			}
+			auto core = cores[threadIndex % cores.size()];
+			m_numaNode = m_topology.GetNodeOfCore(core);
+			if (!CPUTopology::PinCurrentThread(core))
+			{
+				LOG_WARN("Failed to pin thread {} to core {}", threadIndex, core);
+			}
+		}
+
 		void RunJob(Job* job)
 		{
 			if (job == nullptr)
@@ -362,11 +803,27 @@ namespace tako
 			ASSERT(!job->Done());
 			if (job)
 			{
-				job->Run();
+				RunTraced(job);
 			}
 			m_runningJob = nullptr;
 		}
 
+		static void RunTraced(Job* job)
+		{
+#ifdef TAKO_TRACE
+			// The job might be finished and destroyed by another thread once Run returns, so don't touch it afterwards
+			const char* name = job->m_traceName;
+			auto id = reinterpret_cast<std::uintptr_t>(job);
+			Trace::Record(job->m_traceStarted ? Trace::EventType::Resume : Trace::EventType::Begin, name, id);
+			job->m_traceStarted = true;
+			Job::m_traceFinished = false;
+			job->Run();
+			Trace::Record(Job::m_traceFinished ? Trace::EventType::End : Trace::EventType::Suspend, name, id);
+#else
+			job->Run();
+#endif
+		}
+
 		Job* GetJob()
 		{
 			std::unique_lock<std::mutex> lock(m_globalQueueMutex);
@@ -391,6 +848,101 @@ namespace tako
 		}
 	}
 
+	void TaskGroup::BeginSuspend()
+	{
+		m_waiter = JobSystem::m_runningJob;
+		ASSERT(m_waiter);
+	}
+
+	bool TaskGroup::Attach(Job* member)
+	{
+		m_attached.fetch_add(1);
+		TaskGroup* expected = nullptr;
+		if (member->m_group.compare_exchange_strong(expected, this))
+		{
+			return true;
+		}
+		m_attached.fetch_sub(1);
+		return false;
+	}
+
+	bool TaskGroup::Detach(Job* member)
+	{
+		TaskGroup* expected = this;
+		if (member->m_group.compare_exchange_strong(expected, nullptr))
+		{
+			m_attached.fetch_sub(1);
+			return true;
+		}
+		return false;
+	}
+
+	bool TaskGroup::Register(size_t finishedMembers)
+	{
+		if (m_waitForAll)
+		{
+			size_t release = finishedMembers + 1;
+			return m_pending.fetch_sub(release) == release;
+		}
+
+		if (finishedMembers > 0 && !m_triggered.exchange(true))
+		{
+			m_pending.fetch_sub(1);
+		}
+		return m_pending.fetch_sub(1) == 1;
+	}
+
+	void TaskGroup::WaitForDetached()
+	{
+		// Members that already claimed the group are only a few instructions away from releasing it
+		while (m_attached.load(std::memory_order_acquire) > 0)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	void TaskGroup::OnMemberFinished()
+	{
+		// The group may be gone as soon as the last counter is released, so read everything needed upfront
+		Job* waiter = m_waiter;
+		if (m_waitForAll)
+		{
+			if (m_pending.fetch_sub(1) == 1)
+			{
+				JobSystem::ReScheduleJob(waiter);
+			}
+			return;
+		}
+
+		bool wake = !m_triggered.exchange(true) && m_pending.fetch_sub(1) == 1;
+		m_attached.fetch_sub(1, std::memory_order_release);
+		if (wake)
+		{
+			JobSystem::ReScheduleJob(waiter);
+		}
+	}
+
+	void AsyncLatch::CountDown()
+	{
+		if (m_count.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		{
+			return;
+		}
+		// Only a waiter that already suspended needs a reschedule, otherwise await_suspend sees Done and continues
+		if (m_state.exchange(State::Done, std::memory_order_acq_rel) == State::Waiting)
+		{
+			JobSystem::ReScheduleJob(m_waiter);
+		}
+	}
+
+	bool AsyncLatch::await_suspend(std::coroutine_handle<> handle) noexcept
+	{
+		m_waiter = JobSystem::m_runningJob;
+		ASSERT(m_waiter);
+		State expected = State::Pending;
+		return m_state.compare_exchange_strong(expected, State::Waiting, std::memory_order_acq_rel);
+	}
+
 	template<typename Promise>
 	constexpr void InitialTaskAwaiter::await_suspend(std::coroutine_handle<Promise> handle) const noexcept
 	{
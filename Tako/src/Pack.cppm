@@ -0,0 +1,184 @@
+module;
+#include "Utility.hpp"
+#include "stb_image.h"
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <algorithm>
+export module Tako.Pack;
+
+import Tako.NumberTypes;
+import Tako.StringView;
+import Tako.Hash;
+import Tako.IO;
+
+namespace tako
+{
+	// Layout of a pack file: header, index sorted by path hash, path strings, then the blobs,
+	// each starting at a PackAlignment boundary. All offsets count from the start of the file.
+	export constexpr U32 PackMagic = 0x4B415054; // "TPAK"
+	export constexpr U32 PackVersion = 1;
+	export constexpr size_t PackAlignment = 64;
+
+	export enum class PackCompression : U32
+	{
+		None,
+		Zlib
+	};
+
+	export struct PackHeader
+	{
+		U32 magic;
+		U32 version;
+		U32 entryCount;
+		U32 reserved;
+		U64 indexOffset;
+		U64 pathsOffset;
+	};
+
+	export struct PackEntry
+	{
+		U64 pathHash;
+		U64 offset;
+		// Size of the file itself, storedSize is what it takes up in the pack
+		U64 size;
+		U64 storedSize;
+		U32 pathOffset;
+		U32 pathLength;
+		PackCompression compression;
+		U32 reserved;
+	};
+
+	// Paths are stored as they are passed to the VFS, e.g. "/Textures/tree.png"
+	export U64 HashPackPath(std::string_view path)
+	{
+		return Hash::HashStr(path);
+	}
+
+	// Read-only access to a mapped pack file. Uncompressed entries are served straight from the mapping.
+	export class PackArchive
+	{
+	public:
+		bool Open(StringView path)
+		{
+			m_file = IO::Map(path);
+			if (!m_file.IsValid() || m_file.GetSize() < sizeof(PackHeader))
+			{
+				LOG_ERR("Could not open pack {}", path.ToStringView());
+				return false;
+			}
+
+			auto data = m_file.GetData();
+			auto header = reinterpret_cast<const PackHeader*>(data);
+			if (header->magic != PackMagic || header->version != PackVersion)
+			{
+				LOG_ERR("{} is not a pack of version {}", path.ToStringView(), PackVersion);
+				m_file = {};
+				return false;
+			}
+			if (header->indexOffset + header->entryCount * sizeof(PackEntry) > m_file.GetSize() || header->pathsOffset > m_file.GetSize())
+			{
+				LOG_ERR("Pack {} is truncated", path.ToStringView());
+				m_file = {};
+				return false;
+			}
+
+			m_entries = { reinterpret_cast<const PackEntry*>(data + header->indexOffset), header->entryCount };
+			m_paths = reinterpret_cast<const char*>(data + header->pathsOffset);
+			for (auto& entry : m_entries)
+			{
+				if (entry.offset + entry.storedSize > m_file.GetSize() || header->pathsOffset + entry.pathOffset + entry.pathLength > m_file.GetSize())
+				{
+					LOG_ERR("Pack {} has an entry outside of the file", path.ToStringView());
+					m_file = {};
+					m_entries = {};
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool IsOpen() const
+		{
+			return m_file.IsValid();
+		}
+
+		const PackEntry* Find(std::string_view path) const
+		{
+			U64 hash = HashPackPath(path);
+			auto it = std::lower_bound(m_entries.begin(), m_entries.end(), hash, [](const PackEntry& entry, U64 hash)
+			{
+				return entry.pathHash < hash;
+			});
+			// Colliding hashes sit next to each other, the stored path decides
+			for (; it != m_entries.end() && it->pathHash == hash; ++it)
+			{
+				if (GetPath(*it) == path)
+				{
+					return &*it;
+				}
+			}
+			return nullptr;
+		}
+
+		std::string_view GetPath(const PackEntry& entry) const
+		{
+			return { m_paths + entry.pathOffset, entry.pathLength };
+		}
+
+		std::span<const PackEntry> GetEntries() const
+		{
+			return m_entries;
+		}
+
+		// The bytes as stored, only the file content if the entry isn't compressed
+		std::span<const U8> GetStoredData(const PackEntry& entry) const
+		{
+			return { m_file.GetData() + entry.offset, entry.storedSize };
+		}
+
+		// Decompresses into target, which has to hold entry.size bytes
+		bool Read(const PackEntry& entry, U8* target) const
+		{
+			auto stored = GetStoredData(entry);
+			switch (entry.compression)
+			{
+				case PackCompression::None:
+					std::memcpy(target, stored.data(), stored.size());
+					return true;
+				case PackCompression::Zlib:
+				{
+					int decoded = stbi_zlib_decode_buffer(reinterpret_cast<char*>(target), static_cast<int>(entry.size), reinterpret_cast<const char*>(stored.data()), static_cast<int>(stored.size()));
+					if (decoded != static_cast<int>(entry.size))
+					{
+						LOG_ERR("Could not decompress {} from pack", GetPath(entry));
+						return false;
+					}
+					return true;
+				}
+			}
+			return false;
+		}
+
+		// Borrows the mapping when possible, so it must not outlive the archive
+		IO::MappedFile Map(const PackEntry& entry) const
+		{
+			if (entry.compression == PackCompression::None)
+			{
+				return IO::MappedFile::FromView(GetStoredData(entry));
+			}
+
+			std::unique_ptr<U8[]> buffer(new U8[entry.size]);
+			if (!Read(entry, buffer.get()))
+			{
+				return {};
+			}
+			return IO::MappedFile::FromBuffer(std::move(buffer), entry.size);
+		}
+	private:
+		IO::MappedFile m_file;
+		std::span<const PackEntry> m_entries;
+		const char* m_paths = nullptr;
+	};
+}
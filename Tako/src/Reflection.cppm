@@ -3,13 +3,15 @@ module;
 #include <memory>
 #include <cstddef>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <span>
 #include "fmt/format.h"
 export module Tako.Reflection;
 
 import Tako.StringView;
 import Tako.NumberTypes;
+import Tako.FlatHashMap;
+import Tako.StringID;
 
 namespace tako::Reflection
 {
@@ -54,7 +56,7 @@ namespace tako::Reflection
 	{
 		inline auto& GetTypeRegistry()
 		{
-			static std::unordered_map<std::string_view, const tako::Reflection::StructInformation*> registry;
+			static FlatHashMap<StringID, const tako::Reflection::StructInformation*> registry;
 			return registry;
 		}
 	}
@@ -65,7 +67,7 @@ namespace tako::Reflection
 		{
 			init(this);
 			this->kind = TypeKind::Struct;
-			Detail::GetTypeRegistry()[this->name] = this;
+			Detail::GetTypeRegistry()[StringID::Intern(this->name)] = this;
 		}
 
 		struct Field
@@ -230,9 +232,14 @@ namespace tako::Reflection
 		}
 
 		static const StructInformation* GetTypeByName(std::string_view name)
+		{
+			return GetTypeByID(StringID(name));
+		}
+
+		static const StructInformation* GetTypeByID(StringID id)
 		{
 			auto& registry = Detail::GetTypeRegistry();
-			auto it = registry.find(name);
+			auto it = registry.find(id);
 			return it != registry.end() ? it->second : nullptr;
 		}
 
@@ -15,7 +15,9 @@ module;
 */
 #include <array>
 #include <algorithm>
-#include <unordered_map>
+#include <memory>
+#include <span>
+#include <mutex>
 export module Tako.Renderer3D;
 
 //import fastgltf;
@@ -26,6 +28,8 @@ import Tako.Math;
 import Tako.Resources;
 import Tako.CSG;
 import Tako.HandleVec;
+import Tako.FlatHashMap;
+import Tako.Allocators.StackAllocator;
 
 
 template <>
@@ -229,20 +233,61 @@ namespace tako
 		void ReleaseTexture(Texture texture)
 		{
 			m_context->ReleaseTexture(texture);
+			std::lock_guard lock(m_textureSizeMutex);
+			m_textureSizes.erase(texture.value);
 		}
 
+		// GPU memory of textures created by the resource loaders, 0 for others
+		size_t GetTextureSize(Texture texture)
+		{
+			std::lock_guard lock(m_textureSizeMutex);
+			auto it = m_textureSizes.find(texture.value);
+			return it != m_textureSizes.end() ? it->second : 0;
+		}
+
+		// The loaders below may run on workers, Resources serializes them against each other.
+		// Calling CreateTexture or ReleaseTexture directly stays on the render thread.
 		Texture LoadTexture(VFS* vfs, const StringView path)
 		{
-			auto buffer = vfs->LoadFile(path);
-			Bitmap tex = Bitmap::FromFileData(buffer.data(), buffer.size());
-			return CreateTexture(tex);
+			auto file = vfs->Map(path);
+			ASSERT(file.IsValid());
+			Bitmap tex = Bitmap::FromFileData(file.GetData(), file.GetSize());
+			auto texture = CreateTexture(tex);
+			SetTextureSize(texture, tex);
+			return texture;
 		}
 
 		void ReloadTexture(Texture texture, VFS* vfs, const StringView path)
 		{
-			auto buffer = vfs->LoadFile(path);
-			Bitmap tex = Bitmap::FromFileData(buffer.data(), buffer.size());
+			auto file = vfs->Map(path);
+			if (!file.IsValid())
+			{
+				LOG_ERR("Could not reload texture {}", path.ToStringView());
+				return;
+			}
+			Bitmap tex = Bitmap::FromFileData(file.GetData(), file.GetSize());
 			m_context->UpdateTexture(texture, tex);
+			SetTextureSize(texture, tex);
+		}
+
+		// Shown until LoadAsync swapped the real texture in
+		Texture CreatePlaceholderTexture()
+		{
+			Bitmap placeholder(1, 1, { 255, 255, 255 });
+			auto texture = CreateTexture(placeholder);
+			SetTextureSize(texture, placeholder);
+			return texture;
+		}
+
+		Bitmap DecodeTexture(std::span<const U8> data)
+		{
+			return Bitmap::FromFileData(data.data(), data.size());
+		}
+
+		void ApplyTexture(Texture texture, Bitmap&& bitmap)
+		{
+			m_context->UpdateTexture(texture, bitmap);
+			SetTextureSize(texture, bitmap);
 		}
 
 		Shader CreateShader(const ShaderDescriptor& descriptor)
@@ -275,7 +320,8 @@ namespace tako
 
 		void RegisterLoaders(Resources* resources)
 		{
-			resources->RegisterLoader<Texture>(this, &Renderer3D::LoadTexture, &Renderer3D::ReleaseTexture, &Renderer3D::ReloadTexture);
+			resources->RegisterLoader<Texture>(this, &Renderer3D::LoadTexture, &Renderer3D::ReleaseTexture, &Renderer3D::ReloadTexture, &Renderer3D::GetTextureSize);
+			resources->RegisterAsyncLoader<Texture>(this, &Renderer3D::CreatePlaceholderTexture, &Renderer3D::DecodeTexture, &Renderer3D::ApplyTexture);
 		}
 
 		Skybox CreateSkybox(Texture cubemap);
@@ -284,11 +330,11 @@ namespace tako
 		GraphicsContext* m_context;
 		Sampler m_sampler;
 		Mesh m_cubeMesh;
-		std::unordered_map<Vector3, Mesh> m_cubeMeshCache;
-		std::unordered_map<SphereCubeGenerationParams, Mesh> m_sphereMeshCache;
+		FlatHashMap<Vector3, Mesh> m_cubeMeshCache;
+		FlatHashMap<SphereCubeGenerationParams, Mesh> m_sphereMeshCache;
 		Shader m_defaultShader;
-		HandleVec<Shader, ShaderData> m_shaders;
-		HandleVec<Material, MaterialEntry> m_materials;
+		SlotMap<Shader, ShaderData> m_shaders;
+		SlotMap<Material, MaterialEntry> m_materials;
 		Buffer m_cameraBuffer;
 		ShaderBinding m_cameraBinding;
 		Buffer m_lightSettingsBuffer;
@@ -303,6 +349,15 @@ namespace tako
 
 	private:
 		CameraUniformData m_cameraData;
+		// ReleaseTexture and GetTextureSize are public, so they can come from outside the loader lock
+		std::mutex m_textureSizeMutex;
+		FlatHashMap<U64, size_t> m_textureSizes;
+
+		void SetTextureSize(Texture texture, const ImageView image)
+		{
+			std::lock_guard lock(m_textureSizeMutex);
+			m_textureSizes[texture.value] = size_t(image.GetWidth()) * image.GetHeight() * sizeof(Color);
+		}
 		Shader CreateShaderPipeline(const ShaderDescriptor& descriptor);
 		void CreateLightBuffer(size_t size);
 		void CreateSkyboxPipeline();
@@ -1076,7 +1131,14 @@ namespace tako
 		Model model;
 		fastgltf::Parser parser;
 		std::filesystem::path path(file.ToStringView());
-		auto data = fastgltf::GltfDataBuffer::FromPath(path);;
+		auto mapped = IO::Map(file);
+		if (!mapped.IsValid())
+		{
+			LOG_ERR("Could not open model {}", file.ToStringView());
+			return {};
+		}
+		// The parser needs padding behind the json, so fastgltf still takes one copy of the mapping
+		auto data = fastgltf::GltfDataBuffer::FromBytes(reinterpret_cast<const std::byte*>(mapped.GetData()), mapped.GetSize());
 		if( data.error() != fastgltf::Error::None)
 		{
 			LOG_ERR("gltf data error: {}", fastgltf::getErrorName(data.error()));
@@ -1101,7 +1163,14 @@ namespace tako
 			{
 				[&](fastgltf::sources::URI& filePath)
 				{
-					LOG("{}", filePath.uri.string());
+					auto imageFile = IO::Map((path.parent_path() / filePath.uri.fspath()).string());
+					if (!imageFile.IsValid())
+					{
+						LOG_ERR("Could not open image {}", filePath.uri.string());
+						return;
+					}
+					Bitmap img = Bitmap::FromFileData(imageFile.GetData(), imageFile.GetSize());
+					model.textures[i] = CreateTexture(img);
 				},
 				[&](fastgltf::sources::Vector& vector)
 				{
@@ -1149,23 +1218,25 @@ namespace tako
 		{
 			if (node.meshIndex.has_value())
 			{
-				std::vector<Vertex> vertices;
-				std::vector<U16> indices;
+				// Vertex and index data is only needed until the mesh is uploaded
+				auto& arena = Allocators::GetLoadArena();
 				LOG("{}", node.name);
 				auto& rawMesh = asset.meshes[node.meshIndex.value()];
 				for (auto& primitive : rawMesh.primitives)
 				{
+					Allocators::StackAllocator::Scope scope(arena);
 					//TODO: merge primitives if same material?
 					auto& indexAccessor = asset.accessors[primitive.indicesAccessor.value()];
-					indices.reserve(indexAccessor.count);
-					fastgltf::iterateAccessor<U32>(asset, indexAccessor, [&](U32 index)
+					std::span<U16> indices(reinterpret_cast<U16*>(arena.Allocate(indexAccessor.count * sizeof(U16), alignof(U16))), indexAccessor.count);
+					fastgltf::iterateAccessorWithIndex<U32>(asset, indexAccessor, [&](U32 index, size_t i)
 					{
-						indices.push_back(index);
+						indices[i] = index;
 					});
 
 
 					auto& posAccessor = asset.accessors[primitive.findAttribute("POSITION")->accessorIndex];
-					vertices.resize(posAccessor.count);
+					std::span<Vertex> vertices(reinterpret_cast<Vertex*>(arena.Allocate(posAccessor.count * sizeof(Vertex), alignof(Vertex))), posAccessor.count);
+					std::uninitialized_value_construct(vertices.begin(), vertices.end());
 					fastgltf::iterateAccessorWithIndex<Vector3>(asset, posAccessor, [&](Vector3 pos, size_t index)
 					{
 						Vertex v;
@@ -1,14 +1,26 @@
 module;
 #include "Utility.hpp"
-#include <unordered_map>
 #include <functional>
 #include <bit>
 #include <string>
+#include <vector>
+#include <span>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <shared_mutex>
+#include <thread>
 export module Tako.Resources;
 
 import Tako.StringView;
 import Tako.NumberTypes;
 import Tako.HandleVec;
+import Tako.Hash;
+import Tako.FlatHashMap;
+import Tako.StringID;
+import Tako.JobSystem;
 export import Tako.VFS;
 
 
@@ -21,16 +33,6 @@ TypeID GetTypeID()
 	return reinterpret_cast<TypeID>(&id);
 }
 
-struct string_hash
-{
-	using hash_type = std::hash<std::string_view>;
-	using is_transparent = void;
-
-	std::size_t operator()(const char* str) const { return hash_type{}(str); }
-	std::size_t operator()(std::string_view str) const { return hash_type{}(str); }
-	std::size_t operator()(std::string const& str) const { return hash_type{}(str); }
-};
-
 struct CacheKey
 {
 	tako::U64 handle;
@@ -42,15 +44,11 @@ struct CacheKey
 	}
 };
 
-template<>
-struct std::hash<CacheKey>
+struct CacheKeyHash
 {
-	std::size_t operator()(const CacheKey& cacheKey) const
+	tako::U64 operator()(const CacheKey& cacheKey) const
 	{
-		std::hash<tako::U64> hhash;
-		std::hash<TypeID> thash;
-
-		return hhash(cacheKey.handle) ^ (thash(cacheKey.type) << 1);
+		return tako::Hash::Combine(tako::Hash::HashInt(cacheKey.handle), cacheKey.type);
 	}
 };
 
@@ -61,9 +59,11 @@ namespace tako
 		using LoadMemberPtr = U64(ResourceLoaderFuncs::*)(VFS*, const StringView);
 		using ReleaseMemberPtr = void(ResourceLoaderFuncs::*)(U64);
 		using ReloadMemberPtr = void(ResourceLoaderFuncs::*)(U64, VFS*, const StringView);
+		using SizeMemberPtr = size_t(ResourceLoaderFuncs::*)(U64);
 	public:
 		ResourceLoaderFuncs()
 		{
+			m_mutex = nullptr;
 			m_loader = nullptr;
 			m_memberLoadFunc = nullptr;
 			m_loadInvoker = nullptr;
@@ -71,12 +71,15 @@ namespace tako
 
 		template<typename T, Handle R>
 		ResourceLoaderFuncs(
+			std::recursive_mutex* mutex,
 			T* obj,
 			R (T::*memFn)(VFS* vfs, const StringView),
 			void (T::*releaseFn)(R),
-			void(T::*reloadFn)(R, VFS* vfs, const StringView) = nullptr
+			void(T::*reloadFn)(R, VFS* vfs, const StringView) = nullptr,
+			size_t(T::*sizeFn)(R) = nullptr
 		)
 		{
+			m_mutex = mutex;
 			m_loader = obj;
 			m_memberLoadFunc = reinterpret_cast<LoadMemberPtr>(memFn);
 			m_loadInvoker = [](void* loader, LoadMemberPtr memberFunc, VFS* vfs, const StringView path) -> U64
@@ -103,21 +106,34 @@ namespace tako
 					(o->*m)(std::bit_cast<R>(handle), vfs, path);
 				};
 			}
+			m_memberSizeFunc = reinterpret_cast<SizeMemberPtr>(sizeFn);
+			if (m_memberSizeFunc)
+			{
+				m_sizeInvoker = [](void* loader, SizeMemberPtr memberFunc, U64 handle) -> size_t
+				{
+					T* o = static_cast<T*>(loader);
+					auto m = reinterpret_cast<decltype(sizeFn)>(memberFunc);
+					return (o->*m)(std::bit_cast<R>(handle));
+				};
+			}
 		}
 
 		U64 Load(VFS* vfs, const StringView path)
 		{
+			std::lock_guard lock(*m_mutex);
 			return m_loadInvoker(m_loader, m_memberLoadFunc, vfs, path);
 		}
 
 		void Release(U64 handle)
 		{
+			std::lock_guard lock(*m_mutex);
 			m_releaseInvoker(m_loader, m_memberReleaseFunc, handle);
 		}
 
 		void Reload(U64 handle, VFS* vfs, const StringView path)
 		{
 			ASSERT(m_memberReloadFunc);
+			std::lock_guard lock(*m_mutex);
 			m_reloadInvoker(m_loader, m_memberReloadFunc, handle, vfs, path);
 		}
 
@@ -126,7 +142,20 @@ namespace tako
 			return m_memberReloadFunc;
 		}
 
+		// Bytes the resource takes up, 0 if the loader doesn't report sizes
+		size_t Size(U64 handle)
+		{
+			if (!m_memberSizeFunc)
+			{
+				return 0;
+			}
+			std::lock_guard lock(*m_mutex);
+			return m_sizeInvoker(m_loader, m_memberSizeFunc, handle);
+		}
+
 	private:
+		// Shared with the async loader of the same type
+		std::recursive_mutex* m_mutex;
 		void* m_loader;
 		LoadMemberPtr m_memberLoadFunc;
 		U64(*m_loadInvoker)(void*, LoadMemberPtr, VFS*, const StringView);
@@ -134,10 +163,34 @@ namespace tako
 		void(*m_releaseInvoker)(void*, ReleaseMemberPtr, U64);
 		ReloadMemberPtr m_memberReloadFunc;
 		void(*m_reloadInvoker)(void*, ReloadMemberPtr, U64, VFS*, const StringView) = nullptr;
+		SizeMemberPtr m_memberSizeFunc = nullptr;
+		size_t(*m_sizeInvoker)(void*, SizeMemberPtr, U64) = nullptr;
 	};
 
 	using LoaderFunc = std::function<U64(StringView)>;
 
+	export struct ResourceMemoryStats
+	{
+		// Everything loaded, cached entries included
+		size_t count = 0;
+		size_t bytes = 0;
+		// Released, but kept for the next Load until the budget runs out
+		size_t cachedCount = 0;
+		size_t cachedBytes = 0;
+		size_t budget = 0;
+	};
+
+	struct AsyncLoaderFuncs
+	{
+		std::function<U64()> createPlaceholder;
+		// Runs on a worker, returns the step that swaps the decoded data into the handle on the render thread
+		std::function<std::function<void(U64)>(std::span<const U8>)> decode;
+	};
+
+	// Loading, releasing and reloading are safe from any thread once the loaders are registered.
+	// Calls into a loader are serialized per resource type, so load, release, reload, size, placeholder and apply
+	// never overlap for the same type and may run off the main thread. Only decode runs unlocked and in parallel,
+	// it must not touch loader state. Loaders shared between types have to guard that state themselves.
 	export class Resources
 	{
 	public:
@@ -146,64 +199,292 @@ namespace tako
 			m_vfs = vfs;
 		}
 
+		// Decode tasks still in flight point back here, no new ones are started and the rest is waited for
+		~Resources()
+		{
+			std::unique_lock lock(m_asyncMutex);
+			m_stopping = true;
+			while (!std::all_of(m_asyncTasks.begin(), m_asyncTasks.end(), [](auto& task) { return task->Released(); }))
+			{
+				lock.unlock();
+				std::this_thread::yield();
+				lock.lock();
+			}
+		}
+
+		Resources(const Resources&) = delete;
+		Resources& operator=(const Resources&) = delete;
+
 		template<Handle Handle, typename L>
 		void RegisterLoader(
 			L* loader,
 			Handle(L::*loadFunc)(VFS* vfs, const StringView),
 			void(L::*releaseFunc)(Handle),
-			void(L::*reloadFunc)(Handle, VFS* vfs, const StringView) = nullptr
+			void(L::*reloadFunc)(Handle, VFS* vfs, const StringView) = nullptr,
+			size_t(L::*sizeFunc)(Handle) = nullptr
 		)
 		{
 			ASSERT(loadFunc);
 			ASSERT(releaseFunc);
 			auto id = GetTypeID<Handle>();
-			m_loaders[id] = ResourceLoaderFuncs(loader, loadFunc, releaseFunc, reloadFunc);
+			m_loaders[id] = ResourceLoaderFuncs(&GetLoaderMutex(id), loader, loadFunc, releaseFunc, reloadFunc, sizeFunc);
+			auto [accounting, inserted] = m_accounting.try_emplace(id);
+			if (inserted)
+			{
+				accounting->second = std::make_unique<TypeAccounting>();
+			}
+		}
+
+		// Splits loading for LoadAsync: the placeholder is created right away, decode runs on a worker
+		// and apply replaces the placeholder data on the render thread. A regular loader is still needed for Release.
+		template<Handle Handle, typename L, typename Decoded>
+		void RegisterAsyncLoader(
+			L* loader,
+			Handle(L::*placeholderFunc)(),
+			Decoded(L::*decodeFunc)(std::span<const U8> data),
+			void(L::*applyFunc)(Handle, Decoded&&)
+		)
+		{
+			ASSERT(placeholderFunc);
+			ASSERT(decodeFunc);
+			ASSERT(applyFunc);
+			auto mutex = &GetLoaderMutex(GetTypeID<Handle>());
+			AsyncLoaderFuncs funcs;
+			funcs.createPlaceholder = [=]()
+			{
+				std::lock_guard lock(*mutex);
+				return std::bit_cast<U64>((loader->*placeholderFunc)());
+			};
+			funcs.decode = [=](std::span<const U8> data) -> std::function<void(U64)>
+			{
+				// std::function needs something copyable, decoded data usually isn't
+				auto decoded = std::make_shared<Decoded>((loader->*decodeFunc)(data));
+				return [=](U64 handle)
+				{
+					std::lock_guard lock(*mutex);
+					(loader->*applyFunc)(std::bit_cast<Handle>(handle), std::move(*decoded));
+				};
+			};
+			m_asyncLoaders[GetTypeID<Handle>()] = std::move(funcs);
 		}
 
 		template<Handle Handle>
 		Handle Load(StringView path)
 		{
 			auto typeID = GetTypeID<Handle>();
+			StringID pathID(path.ToStringView());
+			auto [entry, created] = Acquire(typeID, pathID, path);
+			if (created)
+			{
+				auto loader = m_loaders.find(typeID);
+				ASSERT(loader != m_loaders.end());
+				Publish(entry, pathID, loader->second.Load(m_vfs, path));
+			}
+			return std::bit_cast<Handle>(entry->handle);
+		}
+
+		// Returns a handle bound to a placeholder right away, the data is swapped in by ApplyAsyncLoads once decoded.
+		// Requests for a path that is already loaded or still loading share the same handle.
+		// Types without an async loader are loaded synchronously.
+		template<Handle Handle>
+		Handle LoadAsync(StringView path)
+		{
+			auto typeID = GetTypeID<Handle>();
+			StringID pathID(path.ToStringView());
+			auto [entry, created] = Acquire(typeID, pathID, path);
+			if (!created)
+			{
+				return std::bit_cast<Handle>(entry->handle);
+			}
+
+			auto asyncLoader = m_asyncLoaders.find(typeID);
+			if (asyncLoader == m_asyncLoaders.end())
 			{
-				auto it = m_pathCache.find(path.ToStringView());
-				if (it != m_pathCache.end())
+				auto loader = m_loaders.find(typeID);
+				ASSERT(loader != m_loaders.end());
+				Publish(entry, pathID, loader->second.Load(m_vfs, path));
+				return std::bit_cast<Handle>(entry->handle);
+			}
+			entry->pending = true;
+			auto handle = asyncLoader->second.createPlaceholder();
+			Publish(entry, pathID, handle);
+
+			std::lock_guard lock(m_asyncMutex);
+			if (!m_stopping)
+			{
+				JobSystem::DetachNextTask();
+				m_asyncTasks.emplace_back(new Task<>(DecodeAsync(asyncLoader->second.decode, pathID, handle, 0, std::string(path))));
+			}
+			return std::bit_cast<Handle>(handle);
+		}
+
+		// Released resources of the type stay cached while everything of the type fits into the budget,
+		// the least recently released are evicted first. Needs a loader that reports sizes, 0 turns caching off.
+		template<Handle Handle>
+		void SetBudget(size_t bytes)
+		{
+			auto& accounting = GetAccounting(GetTypeID<Handle>());
+			{
+				std::lock_guard lock(accounting.mutex);
+				accounting.stats.budget = bytes;
+			}
+			Trim(accounting);
+		}
+
+		template<Handle Handle>
+		ResourceMemoryStats GetMemoryStats()
+		{
+			auto& accounting = GetAccounting(GetTypeID<Handle>());
+			std::lock_guard lock(accounting.mutex);
+			return accounting.stats;
+		}
+
+		// Evicts every cached entry, regardless of the budgets
+		void ClearCache()
+		{
+			for (auto& [_, accounting] : m_accounting)
+			{
+				Trim(*accounting, true);
+			}
+		}
+
+		// Reloads a batch of changed files, e.g. everything the FileWatcher reported this frame. Duplicates are dropped,
+		// types with an async loader decode on the workers and are swapped in by ApplyAsyncLoads, the others reload right away.
+		void ReloadBatch(std::span<const std::string> paths)
+		{
+			std::vector<const std::string*> unique;
+			unique.reserve(paths.size());
+			for (auto& path : paths)
+			{
+				unique.push_back(&path);
+			}
+			std::sort(unique.begin(), unique.end(), [](auto a, auto b) { return *a < *b; });
+			unique.erase(std::unique(unique.begin(), unique.end(), [](auto a, auto b) { return *a == *b; }), unique.end());
+			for (auto path : unique)
+			{
+				if (!ReloadAsync(*path))
 				{
-					auto& entry = it->second;
-					ASSERT(typeID == entry.type);
-					entry.refCount++;
-					return std::bit_cast<Handle>(entry.handle);
+					Reload(*path);
 				}
 			}
+		}
+
+		// Swaps in the data of finished LoadAsync and ReloadBatch requests, call on the render thread
+		void ApplyAsyncLoads()
+		{
+			std::vector<AsyncApply> applies;
+			std::vector<TypeAccounting*> resized;
+			std::vector<std::string> changedWhileLoading;
+			{
+				std::lock_guard lock(m_asyncMutex);
+				applies.swap(m_asyncApplies);
+				std::erase_if(m_asyncTasks, [](auto& task)
+				{
+					return task->Released();
+				});
+			}
 
-			auto loader = m_loaders.find(typeID);
-			ASSERT(loader != m_loaders.end());
-			CacheEntry entry;
-			entry.type = typeID;
-			entry.handle = loader->second.Load(m_vfs, path);
-			entry.refCount = 1;
-			auto [inserted, _] = m_pathCache.emplace(std::make_pair(std::string(path), entry));
-			m_handleCache.emplace(std::make_pair(entry, std::string_view(inserted->first)));
-			return std::bit_cast<Handle>(entry.handle);
+			for (auto& apply : applies)
+			{
+				auto& shard = GetShard(apply.pathID);
+				// Shared is enough, the entry can only be erased under the exclusive lock
+				std::shared_lock lock(shard.mutex);
+				auto it = shard.entries.find(apply.pathID);
+				// Released while decoding, the handle might already belong to something else
+				if (it == shard.entries.end() || it->second->handle != apply.handle)
+				{
+					continue;
+				}
+				// Loads replace the placeholder once, reloads only apply if the file wasn't reloaded again since
+				auto& entry = *it->second;
+				bool current = apply.version == 0 ? entry.pending.exchange(false) : entry.reloadVersion.load(std::memory_order_relaxed) == apply.version;
+				if (!current)
+				{
+					continue;
+				}
+				if (apply.apply)
+				{
+					apply.apply(apply.handle);
+					UpdateSize(&entry);
+					resized.push_back(entry.accounting);
+				}
+				if (apply.version == 0 && entry.reloadQueued.exchange(false))
+				{
+					changedWhileLoading.push_back(entry.path);
+				}
+			}
+
+			// Outside of the shard locks, evicting needs them exclusively
+			for (auto accounting : resized)
+			{
+				Trim(*accounting);
+			}
+			// The load might have read the file before it changed
+			if (changedWhileLoading.size() > 0)
+			{
+				ReloadBatch(changedWhileLoading);
+			}
 		}
 
 		template<Handle Handle>
 		void Release(Handle resource)
 		{
 			auto typeID = GetTypeID<Handle>();
-			auto loader = m_loaders.find(typeID);
-			ASSERT(loader != m_loaders.end());
 			auto handle = std::bit_cast<U64>(resource);
-			loader->second.Release(handle);
+			CacheKey key{ handle, typeID };
+			HandleEntry found;
+			{
+				auto& handleShard = GetShard(key);
+				std::shared_lock lock(handleShard.mutex);
+				auto itHandle = handleShard.handles.find(key);
+				ASSERT(itHandle != handleShard.handles.end());
+				found = itHandle->second;
+			}
+
+			// The caller still holds its reference, so the entry stays alive until the decrement.
+			// Only the last one needs the lock, which keeps Acquire from reviving an entry that is being erased.
+			auto entry = found.entry;
+			U32 count = entry->refCount.load(std::memory_order_relaxed);
+			while (count > 1)
+			{
+				if (entry->refCount.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel))
+				{
+					return;
+				}
+			}
 
-			auto itHandle = m_handleCache.find({ handle, typeID });
-			ASSERT(itHandle != m_handleCache.end());
-			auto itEntry = m_pathCache.find(itHandle->second);
-			ASSERT(itEntry != m_pathCache.end());
-			itEntry->second.refCount--;
-			if (itEntry->second.refCount == 0)
+			std::unique_ptr<CacheEntry> erased;
+			auto& accounting = *entry->accounting;
 			{
-				m_pathCache.erase(itEntry);
-				m_handleCache.erase(itHandle);
+				auto& shard = GetShard(found.pathID);
+				std::unique_lock lock(shard.mutex);
+				if (entry->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1)
+				{
+					return;
+				}
+				std::lock_guard accountingLock(accounting.mutex);
+				// Placeholders still waiting for their data aren't worth keeping
+				if (accounting.stats.budget > 0 && !entry->pending)
+				{
+					LinkFront(accounting, entry);
+				}
+				else
+				{
+					accounting.stats.count--;
+					accounting.stats.bytes -= entry->size;
+					auto itEntry = shard.entries.find(found.pathID);
+					ASSERT(itEntry != shard.entries.end());
+					erased = std::move(itEntry->second);
+					shard.entries.erase(itEntry);
+				}
+			}
+			if (erased)
+			{
+				ReleaseEntry(*erased);
+			}
+			else
+			{
+				Trim(accounting);
 			}
 		}
 
@@ -218,35 +499,411 @@ namespace tako
 				return;
 			}
 			auto handle = std::bit_cast<U64>(resource);
-			auto itHandle = m_handleCache.find({ handle, typeID });
-			ASSERT(itHandle != m_handleCache.end());
-			loader->second.Reload(handle, itHandle->second);
+			CacheKey key{ handle, typeID };
+			HandleEntry found;
+			{
+				auto& handleShard = GetShard(key);
+				std::shared_lock lock(handleShard.mutex);
+				auto itHandle = handleShard.handles.find(key);
+				ASSERT(itHandle != handleShard.handles.end());
+				found = itHandle->second;
+			}
+			auto& shard = GetShard(found.pathID);
+			std::shared_lock lock(shard.mutex);
+			auto itEntry = shard.entries.find(found.pathID);
+			if (itEntry == shard.entries.end() || itEntry->second.get() != found.entry || found.entry->pending)
+			{
+				return;
+			}
+			loader->second.Reload(handle, m_vfs, found.entry->path);
+			UpdateSize(found.entry);
 		}
 
 		void Reload(const StringView path)
 		{
-			auto itEntry = m_pathCache.find(path.ToStringView());
-			if (itEntry == m_pathCache.end())
+			StringID pathID(path.ToStringView());
+			auto& shard = GetShard(pathID);
+			std::shared_lock lock(shard.mutex);
+			auto itEntry = shard.entries.find(pathID);
+			if (itEntry == shard.entries.end())
+			{
+				return;
+			}
+			auto& entry = *itEntry->second;
+			if (!entry.ready.load(std::memory_order_acquire) || entry.pending)
 			{
 				return;
 			}
-			auto loader = m_loaders.find(itEntry->second.type);
+			auto loader = m_loaders.find(entry.type);
 			ASSERT(loader != m_loaders.end());
 			if (!loader->second.CanReload())
 			{
 				return;
 			}
-			loader->second.Reload(itEntry->second.handle, m_vfs, path);
+			loader->second.Reload(entry.handle, m_vfs, path);
+			UpdateSize(&entry);
 		}
 	private:
 		VFS* m_vfs;
+		struct TypeAccounting;
+
 		struct CacheEntry : public CacheKey
 		{
-			U32 refCount;
+			std::atomic<U32> refCount = 0;
+			// Set once the handle is valid, others wait for it while the first requester runs the loader
+			std::atomic<bool> ready = false;
+			// Still showing the placeholder of a LoadAsync
+			std::atomic<bool> pending = false;
+			// Bumped by every async reload, so a slow decode doesn't overwrite the result of a newer one
+			std::atomic<U32> reloadVersion = 0;
+			// The file changed while it was still loading, reloaded once the load is done
+			std::atomic<bool> reloadQueued = false;
+			std::string path;
+			StringID pathID;
+			TypeAccounting* accounting = nullptr;
+			// Guarded by the accounting mutex, cached entries have no references and sit in the LRU list
+			size_t size = 0;
+			bool cached = false;
+			CacheEntry* lruPrev = nullptr;
+			CacheEntry* lruNext = nullptr;
+		};
+
+		struct TypeAccounting
+		{
+			std::mutex mutex;
+			ResourceMemoryStats stats;
+			// Most recently released at the front
+			CacheEntry* lruFront = nullptr;
+			CacheEntry* lruBack = nullptr;
 		};
 
-		std::unordered_map<TypeID, ResourceLoaderFuncs> m_loaders;
-		std::unordered_map<std::string, CacheEntry, string_hash, std::equal_to<>> m_pathCache;
-		std::unordered_map<CacheKey, std::string_view> m_handleCache;
+		struct HandleEntry
+		{
+			StringID pathID;
+			CacheEntry* entry = nullptr;
+		};
+
+		struct AsyncApply
+		{
+			StringID pathID;
+			U64 handle;
+			// 0 for LoadAsync, the entry's reloadVersion for reloads
+			U32 version;
+			// Empty if the file couldn't be read, the placeholder stays
+			std::function<void(U64)> apply;
+		};
+
+		// Entries are allocated separately, so they stay in place while the maps grow
+		struct alignas(64) PathShard
+		{
+			std::shared_mutex mutex;
+			FlatHashMap<StringID, std::unique_ptr<CacheEntry>> entries;
+		};
+
+		struct alignas(64) HandleShard
+		{
+			std::shared_mutex mutex;
+			FlatHashMap<CacheKey, HandleEntry, CacheKeyHash> handles;
+		};
+
+		static constexpr size_t ShardBits = 4;
+		static constexpr size_t ShardCount = size_t(1) << ShardBits;
+
+		// Only written while registering, before loads can come from other threads
+		FlatHashMap<TypeID, ResourceLoaderFuncs> m_loaders;
+		FlatHashMap<TypeID, AsyncLoaderFuncs> m_asyncLoaders;
+		FlatHashMap<TypeID, std::unique_ptr<TypeAccounting>> m_accounting;
+		// Recursive, loaders can load or trim their own type again while they hold it
+		FlatHashMap<TypeID, std::unique_ptr<std::recursive_mutex>> m_loaderMutexes;
+		// Keyed by the hashed path, so lookups compare 64 bit IDs instead of strings
+		std::array<PathShard, ShardCount> m_pathShards;
+		std::array<HandleShard, ShardCount> m_handleShards;
+
+		std::mutex m_asyncMutex;
+		std::vector<std::unique_ptr<Task<>>> m_asyncTasks;
+		bool m_stopping = false;
+		std::vector<AsyncApply> m_asyncApplies;
+
+		// Shards pick the top bits, FlatHashMap uses the low ones for its slots
+		PathShard& GetShard(StringID pathID)
+		{
+			return m_pathShards[pathID.GetHash() >> (64 - ShardBits)];
+		}
+
+		HandleShard& GetShard(const CacheKey& key)
+		{
+			return m_handleShards[CacheKeyHash()(key) >> (64 - ShardBits)];
+		}
+
+		// Takes a reference on the entry of the path, created if there is none yet.
+		// Existing entries are returned once their handle is published, created ones have to be published by the caller.
+		std::pair<CacheEntry*, bool> Acquire(TypeID typeID, StringID pathID, StringView path)
+		{
+			auto& shard = GetShard(pathID);
+			CacheEntry* entry = nullptr;
+			{
+				std::shared_lock lock(shard.mutex);
+				auto it = shard.entries.find(pathID);
+				if (it != shard.entries.end())
+				{
+					entry = it->second.get();
+					if (entry->refCount.fetch_add(1, std::memory_order_relaxed) == 0)
+					{
+						Revive(entry);
+					}
+				}
+			}
+			if (!entry)
+			{
+				std::unique_lock lock(shard.mutex);
+				auto [it, inserted] = shard.entries.try_emplace(pathID);
+				if (inserted)
+				{
+					it->second = std::make_unique<CacheEntry>();
+					entry = it->second.get();
+					entry->type = typeID;
+					entry->refCount = 1;
+					entry->path = std::string(path);
+					entry->pathID = pathID;
+					entry->accounting = &GetAccounting(typeID);
+					lock.unlock();
+					StringID::Intern(entry->path);
+					return { entry, true };
+				}
+				// Someone else created it in the meantime
+				entry = it->second.get();
+				if (entry->refCount.fetch_add(1, std::memory_order_relaxed) == 0)
+				{
+					Revive(entry);
+				}
+			}
+
+			ASSERT(typeID == entry->type);
+			entry->ready.wait(false, std::memory_order_acquire);
+			return { entry, false };
+		}
+
+		void Publish(CacheEntry* entry, StringID pathID, U64 handle)
+		{
+			entry->handle = handle;
+			{
+				CacheKey key{ handle, entry->type };
+				auto& handleShard = GetShard(key);
+				std::unique_lock lock(handleShard.mutex);
+				handleShard.handles.try_emplace(key, HandleEntry{ pathID, entry });
+			}
+			// Sequentially consistent, together with reloadQueued either this or ReloadAsync sees the other's write
+			entry->ready.store(true);
+			entry->ready.notify_all();
+
+			{
+				std::lock_guard lock(entry->accounting->mutex);
+				entry->accounting->stats.count++;
+			}
+			UpdateSize(entry);
+			Trim(*entry->accounting);
+
+			// Async loads pick up queued reloads in ApplyAsyncLoads, once they are no longer pending
+			if (!entry->pending && entry->reloadQueued.exchange(false))
+			{
+				if (!ReloadAsync(entry->path))
+				{
+					Reload(entry->path);
+				}
+			}
+		}
+
+		// Only called while registering, the mutex stays in place after that
+		std::recursive_mutex& GetLoaderMutex(TypeID typeID)
+		{
+			auto [mutex, inserted] = m_loaderMutexes.try_emplace(typeID);
+			if (inserted)
+			{
+				mutex->second = std::make_unique<std::recursive_mutex>();
+			}
+			return *mutex->second;
+		}
+
+		TypeAccounting& GetAccounting(TypeID typeID)
+		{
+			auto it = m_accounting.find(typeID);
+			ASSERT(it != m_accounting.end());
+			return *it->second;
+		}
+
+		// Asks the loader again, after the data behind the handle was created or replaced
+		void UpdateSize(CacheEntry* entry)
+		{
+			auto loader = m_loaders.find(entry->type);
+			ASSERT(loader != m_loaders.end());
+			size_t size = loader->second.Size(entry->handle);
+			auto& accounting = *entry->accounting;
+			std::lock_guard lock(accounting.mutex);
+			accounting.stats.bytes = accounting.stats.bytes - entry->size + size;
+			if (entry->cached)
+			{
+				accounting.stats.cachedBytes = accounting.stats.cachedBytes - entry->size + size;
+			}
+			entry->size = size;
+		}
+
+		// Called with the accounting mutex held
+		void LinkFront(TypeAccounting& accounting, CacheEntry* entry)
+		{
+			entry->cached = true;
+			entry->lruPrev = nullptr;
+			entry->lruNext = accounting.lruFront;
+			if (accounting.lruFront)
+			{
+				accounting.lruFront->lruPrev = entry;
+			}
+			else
+			{
+				accounting.lruBack = entry;
+			}
+			accounting.lruFront = entry;
+			accounting.stats.cachedCount++;
+			accounting.stats.cachedBytes += entry->size;
+		}
+
+		// Called with the accounting mutex held
+		void Unlink(TypeAccounting& accounting, CacheEntry* entry)
+		{
+			(entry->lruPrev ? entry->lruPrev->lruNext : accounting.lruFront) = entry->lruNext;
+			(entry->lruNext ? entry->lruNext->lruPrev : accounting.lruBack) = entry->lruPrev;
+			entry->lruPrev = nullptr;
+			entry->lruNext = nullptr;
+			entry->cached = false;
+			accounting.stats.cachedCount--;
+			accounting.stats.cachedBytes -= entry->size;
+		}
+
+		// A cached entry got its first reference again, runs under the shard lock so eviction can't race it
+		void Revive(CacheEntry* entry)
+		{
+			auto& accounting = *entry->accounting;
+			std::lock_guard lock(accounting.mutex);
+			if (entry->cached)
+			{
+				Unlink(accounting, entry);
+			}
+		}
+
+		// Evicts the least recently released entries until the type fits into its budget, or all of them if clear is set
+		void Trim(TypeAccounting& accounting, bool clear = false)
+		{
+			while (true)
+			{
+				CacheEntry* victim;
+				StringID pathID;
+				{
+					std::lock_guard lock(accounting.mutex);
+					victim = accounting.lruBack;
+					bool overBudget = accounting.stats.budget == 0 || accounting.stats.bytes > accounting.stats.budget;
+					if (!victim || (!clear && !overBudget))
+					{
+						return;
+					}
+					pathID = victim->pathID;
+				}
+
+				// The shard lock has to come first, so the victim is checked again once it's held
+				std::unique_ptr<CacheEntry> erased;
+				{
+					auto& shard = GetShard(pathID);
+					std::unique_lock lock(shard.mutex);
+					auto it = shard.entries.find(pathID);
+					if (it == shard.entries.end() || it->second.get() != victim)
+					{
+						continue;
+					}
+					std::lock_guard accountingLock(accounting.mutex);
+					if (!victim->cached)
+					{
+						continue;
+					}
+					Unlink(accounting, victim);
+					accounting.stats.count--;
+					accounting.stats.bytes -= victim->size;
+					erased = std::move(it->second);
+					shard.entries.erase(it);
+				}
+				ReleaseEntry(*erased);
+			}
+		}
+
+		// Hands an entry that already left its path shard back to the loader
+		void ReleaseEntry(const CacheEntry& entry)
+		{
+			CacheKey key{ entry.handle, entry.type };
+			{
+				// The loader hasn't released the handle yet, so nobody could have reused the key
+				auto& handleShard = GetShard(key);
+				std::unique_lock lock(handleShard.mutex);
+				handleShard.handles.erase(key);
+			}
+
+			auto loader = m_loaders.find(entry.type);
+			ASSERT(loader != m_loaders.end());
+			loader->second.Release(entry.handle);
+		}
+
+		// Returns false if the type has no async loader and has to be reloaded synchronously
+		bool ReloadAsync(const std::string& path)
+		{
+			StringID pathID(path);
+			const AsyncLoaderFuncs* asyncLoader;
+			U64 handle;
+			U32 version;
+			{
+				auto& shard = GetShard(pathID);
+				std::shared_lock lock(shard.mutex);
+				auto itEntry = shard.entries.find(pathID);
+				if (itEntry == shard.entries.end())
+				{
+					return true;
+				}
+				auto& entry = *itEntry->second;
+				if (!entry.ready.load(std::memory_order_acquire) || entry.pending)
+				{
+					// The load may have read the file already, Publish or ApplyAsyncLoads reloads it once done.
+					// If it finished in the meantime whoever takes the flag back does the reload.
+					entry.reloadQueued = true;
+					if (!entry.ready || entry.pending || !entry.reloadQueued.exchange(false))
+					{
+						return true;
+					}
+				}
+				auto found = m_asyncLoaders.find(entry.type);
+				if (found == m_asyncLoaders.end())
+				{
+					return false;
+				}
+				asyncLoader = &found->second;
+				handle = entry.handle;
+				version = entry.reloadVersion.fetch_add(1, std::memory_order_relaxed) + 1;
+			}
+
+			std::lock_guard lock(m_asyncMutex);
+			if (!m_stopping)
+			{
+				JobSystem::DetachNextTask();
+				m_asyncTasks.emplace_back(new Task<>(DecodeAsync(asyncLoader->decode, pathID, handle, version, path)));
+			}
+			return true;
+		}
+
+		Task<> DecodeAsync(std::function<std::function<void(U64)>(std::span<const U8>)> decode, StringID pathID, U64 handle, U32 version, std::string path)
+		{
+			auto load = m_vfs->LoadFileAsync(path);
+			auto data = co_await load;
+			AsyncApply apply{ pathID, handle, version };
+			if (!data.empty())
+			{
+				apply.apply = decode(data);
+			}
+			std::lock_guard lock(m_asyncMutex);
+			m_asyncApplies.push_back(std::move(apply));
+		}
 	};
-}
+}
\ No newline at end of file
@@ -2,43 +2,72 @@ module;
 #include "Utility.hpp"
 #include "NumberTypes.hpp"
 #include <utility>
+#include <memory>
+#include <span>
+#include <algorithm>
 export module Tako.SmallVec;
 
+import Tako.Allocators.Allocator;
+
 namespace tako
 {
+	// Keeps up to startCapacity elements inline before going to the heap.
+	// Heap memory comes from the given allocator, or AlignedAlloc if there is none.
 	export template<typename T, size_t startCapacity = 10>
 	class SmallVec
 	{
 	public:
-		SmallVec()
+		SmallVec(Allocator* allocator = nullptr)
 		{
 			m_length = 0;
 			m_capacity = startCapacity;
-			m_data = reinterpret_cast<T*>(&m_reserved[0]);
-			for (size_t i = 0; i < m_length; i++)
-			{
-				new (m_data + i) T();
-			}
+			m_data = GetInline();
+			m_allocator = allocator;
+		}
+
+		SmallVec(std::span<const T> elements, Allocator* allocator = nullptr) : SmallVec(allocator)
+		{
+			Append(elements);
 		}
 
 		~SmallVec()
 		{
-			for (size_t i = 0; i < m_length; i++)
+			Clear();
+			FreeHeap();
+		}
+
+		SmallVec(SmallVec const& other) : SmallVec(other.m_allocator)
+		{
+			Append(other.AsSpan());
+		}
+
+		SmallVec& operator=(SmallVec const& other)
+		{
+			if (this != &other)
 			{
-				m_data[i].~T();
+				Clear();
+				Append(other.AsSpan());
 			}
-			if (reinterpret_cast<U8*>(m_data) != &m_reserved[0])
+			return *this;
+		}
+
+		SmallVec(SmallVec&& other) noexcept : SmallVec(other.m_allocator)
+		{
+			TakeFrom(other);
+		}
+
+		SmallVec& operator=(SmallVec&& other) noexcept
+		{
+			if (this != &other)
 			{
-				delete[] reinterpret_cast<U8*>(m_data);
+				Clear();
+				FreeHeap();
+				m_allocator = other.m_allocator;
+				TakeFrom(other);
 			}
+			return *this;
 		}
 
-		//TODO: implement copy/move semantics
-		SmallVec(SmallVec const& other) = delete;
-		SmallVec& operator=(SmallVec const&) = delete;
-		SmallVec(SmallVec&& other) noexcept = delete;
-		SmallVec& operator=(SmallVec&& other) noexcept = delete;
-
 		size_t GetLength() const
 		{
 			return m_length;
@@ -69,17 +98,22 @@ namespace tako
 			return GetData();
 		}
 
+		bool IsInline() const
+		{
+			return m_data == GetInline();
+		}
+
 		void Push(const T& element)
 		{
 			ReserveSizeForPush();
-			m_data[m_length] = element;
+			new(m_data + m_length) T(element);
 			m_length++;
 		}
 
 		void Push(T&& element)
 		{
 			ReserveSizeForPush();
-			m_data[m_length] = std::move(element);
+			new(m_data + m_length) T(std::move(element));
 			m_length++;
 		}
 
@@ -97,9 +131,10 @@ namespace tako
 			return m_data[m_length - 1];
 		}
 
-		void PushArray(const T* arr, size_t num)
+		// Grows at most once for the whole span
+		void Append(std::span<const T> elements)
 		{
-			size_t newLen = m_length + num;
+			size_t newLen = m_length + elements.size();
 			if (newLen > m_capacity)
 			{
 				size_t newCapacity = m_capacity * 2;
@@ -107,16 +142,18 @@ namespace tako
 				{
 					newCapacity *= 2;
 				}
-				Resize(newCapacity);
+				Reserve(newCapacity);
 			}
 
-			for (int i = 0; i < num; i++)
-			{
-				m_data[m_length + i] = arr[i];
-			}
+			std::uninitialized_copy(elements.begin(), elements.end(), m_data + m_length);
 			m_length = newLen;
 		}
 
+		void PushArray(const T* arr, size_t num)
+		{
+			Append(std::span<const T>(arr, num));
+		}
+
 		void Pop()
 		{
 			if (m_length <= 0)
@@ -130,11 +167,24 @@ namespace tako
 
 		void Clear()
 		{
-			for (size_t i = 0; i < m_length; i++)
+			std::destroy(m_data, m_data + m_length);
+			m_length = 0;
+		}
+
+		//TODO: Handle downsize
+		void Reserve(size_t newCapacity)
+		{
+			if (newCapacity <= m_capacity)
 			{
-				m_data[i].~T();
+				return;
 			}
-			m_length = 0;
+
+			T* newData = reinterpret_cast<T*>(AllocateHeap(newCapacity));
+			std::uninitialized_move(m_data, m_data + m_length, newData);
+			std::destroy(m_data, m_data + m_length);
+			FreeHeap();
+			m_data = newData;
+			m_capacity = newCapacity;
 		}
 
 		T& Front() const
@@ -161,6 +211,17 @@ namespace tako
 			return m_data[index];
 		}
 
+		// Also converts implicitly, as a contiguous range
+		std::span<T> AsSpan()
+		{
+			return { m_data, m_length };
+		}
+
+		std::span<const T> AsSpan() const
+		{
+			return { m_data, m_length };
+		}
+
 		// Iterators might get invalidated by push/resize
 		T* begin() { return m_data; }
 		T* end() { return m_data + m_length; }
@@ -171,30 +232,63 @@ namespace tako
 		{
 			if (m_length >= m_capacity)
 			{
-				Resize(m_capacity * 2);
+				Reserve(m_capacity * 2);
 			}
 		}
 
-		//TODO: Handle downsize
-		void Resize(size_t newCapacity)
+		T* GetInline() const
 		{
-			T* newData = reinterpret_cast<T*>(new U8[sizeof(T) * newCapacity]);
-			if (m_length > 0)
+			return reinterpret_cast<T*>(const_cast<U8*>(&m_reserved[0]));
+		}
+
+		void* AllocateHeap(size_t capacity)
+		{
+			void* p = m_allocator ? m_allocator->Allocate(sizeof(T) * capacity, alignof(T)) : AlignedAlloc(sizeof(T) * capacity, alignof(T));
+			ASSERT(p);
+			return p;
+		}
+
+		// Only releases the memory, elements have to be destroyed already
+		void FreeHeap()
+		{
+			if (!IsInline())
 			{
-				std::move(&m_data[0], &m_data[m_length], &newData[0]);
+				if (m_allocator)
+				{
+					m_allocator->Deallocate(m_data, sizeof(T) * m_capacity, alignof(T));
+				}
+				else
+				{
+					AlignedFree(m_data);
+				}
+				m_data = GetInline();
+				m_capacity = startCapacity;
 			}
+		}
 
-			if (reinterpret_cast<U8*>(m_data) != &m_reserved[0])
+		// Expects to be empty and inline, with the same allocator as other
+		void TakeFrom(SmallVec& other)
+		{
+			if (other.IsInline())
 			{
-				delete[] reinterpret_cast<U8*>(m_data);
+				std::uninitialized_move(other.m_data, other.m_data + other.m_length, m_data);
+				m_length = other.m_length;
+				other.Clear();
+				return;
 			}
-			m_data = newData;
-			m_capacity = newCapacity;
+
+			m_data = other.m_data;
+			m_length = other.m_length;
+			m_capacity = other.m_capacity;
+			other.m_data = other.GetInline();
+			other.m_length = 0;
+			other.m_capacity = startCapacity;
 		}
 
 		T* m_data;
 		size_t m_length;
 		size_t m_capacity;
-		U8 m_reserved[sizeof(T) * startCapacity];
+		Allocator* m_allocator;
+		alignas(T) U8 m_reserved[sizeof(T) * startCapacity];
 	};
 }
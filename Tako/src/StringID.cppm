@@ -0,0 +1,117 @@
+module;
+#include "Utility.hpp"
+#include <string>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <compare>
+export module Tako.StringID;
+
+import Tako.NumberTypes;
+import Tako.Hash;
+import Tako.FlatHashMap;
+
+namespace tako
+{
+	// A string reduced to its 64 bit hash, for keys that are compared far more often than printed.
+	// Literals hash at compile time with "name"_id, Intern also records the text so it can be shown again.
+	export class StringID
+	{
+	public:
+		constexpr StringID() : m_hash(0)
+		{
+		}
+
+		constexpr explicit StringID(std::string_view str) : m_hash(Hash::ConstHashStr(str))
+		{
+		}
+
+		static constexpr StringID FromHash(U64 hash)
+		{
+			StringID id;
+			id.m_hash = hash;
+			return id;
+		}
+
+		// Same as the constructor, but keeps the string around for GetDebugName
+		static StringID Intern(std::string_view str)
+		{
+			StringID id(str);
+			auto& table = GetInternTable();
+			std::lock_guard lock(table.mutex);
+			auto it = table.names.find(id.m_hash);
+			if (it != table.names.end())
+			{
+				if (it->second != str)
+				{
+					LOG_ERR("StringID collision between {} and {}", it->second, str);
+				}
+				return id;
+			}
+			table.storage.emplace_back(str);
+			table.names.try_emplace(id.m_hash, table.storage.back().c_str());
+			return id;
+		}
+
+		constexpr U64 GetHash() const
+		{
+			return m_hash;
+		}
+
+		constexpr bool IsValid() const
+		{
+			return m_hash != 0;
+		}
+
+		// Only knows interned strings, returns an empty string for everything else
+		const char* GetDebugName() const
+		{
+			auto& table = GetInternTable();
+			std::lock_guard lock(table.mutex);
+			auto it = table.names.find(m_hash);
+			return it != table.names.end() ? it->second : "";
+		}
+
+		constexpr bool operator==(const StringID& other) const = default;
+		constexpr auto operator<=>(const StringID& other) const = default;
+	private:
+		U64 m_hash;
+
+		struct InternTable
+		{
+			std::mutex mutex;
+			// deque keeps the strings in place, names can hand out their pointers
+			std::deque<std::string> storage;
+			FlatHashMap<U64, const char*> names;
+		};
+
+		static InternTable& GetInternTable()
+		{
+			static InternTable table;
+			return table;
+		}
+	};
+
+	export consteval StringID operator""_id(const char* str, size_t len)
+	{
+		return StringID(std::string_view(str, len));
+	}
+
+	// rapidhash V1 outputs, one for each path through the hash
+	static_assert(""_id.GetHash() == 0x5a6ef77074ebc84bull);
+	static_assert("abc"_id.GetHash() == 0x0347080fbf5fcd81ull);
+	static_assert("0123456789abcdef"_id.GetHash() == 0xfcc8fa4e2771d2efull);
+	static_assert("0123456789abcdefg"_id.GetHash() == 0xab3c2320d701d807ull);
+	static_assert("0123456789abcdef0123456789abcdef0123456789abcdef"_id.GetHash() == 0x0fbf74f083d4e589ull);
+	static_assert("0123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890123456789"_id.GetHash() == 0x13162ecc50882559ull);
+
+	// Already a rapidhash, no need to mix it again
+	export template<>
+	struct FlatHash<StringID>
+	{
+		U64 operator()(StringID id) const
+		{
+			return id.GetHash();
+		}
+	};
+}
@@ -0,0 +1,243 @@
+module;
+#include "Utility.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <memory>
+#include <iterator>
+#include <thread>
+export module Tako.Trace;
+
+import Tako.NumberTypes;
+import Tako.StringView;
+import Tako.IO;
+
+namespace tako::Trace
+{
+	export enum class EventType : U8
+	{
+		Begin,
+		End,
+		Suspend,
+		Resume,
+		ZoneBegin,
+		ZoneEnd
+	};
+
+#ifdef TAKO_TRACE
+	export constexpr bool Enabled = true;
+
+	struct Event
+	{
+		U64 timestamp;
+		const char* name;
+		U64 id;
+		EventType type;
+	};
+
+	// Per thread, older events get overwritten once full
+	constexpr size_t BufferCapacity = 1 << 14;
+
+	// Threads the JobSystem doesn't know about are numbered from here, so they don't share a track with a worker
+	constexpr unsigned int OtherThreadIndex = 1 << 16;
+
+	struct ThreadBuffer
+	{
+		unsigned int threadIndex;
+		std::atomic<U64> written = 0;
+		// Set while Record writes an event, the dump waits for it so it doesn't read a half written one
+		std::atomic<bool> writing = false;
+		Event events[BufferCapacity];
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+		unsigned int otherThreadCount = 0;
+		std::atomic<bool> paused = false;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	};
+
+	Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	thread_local ThreadBuffer* t_buffer = nullptr;
+
+	ThreadBuffer* GetThreadBuffer()
+	{
+		if (t_buffer == nullptr)
+		{
+			auto& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			auto& buffer = registry.buffers.emplace_back(std::make_unique<ThreadBuffer>());
+			buffer->threadIndex = OtherThreadIndex + registry.otherThreadCount++;
+			t_buffer = buffer.get();
+		}
+		return t_buffer;
+	}
+
+	export void SetThreadIndex(unsigned int index)
+	{
+		GetThreadBuffer()->threadIndex = index;
+	}
+
+	// name has to outlive the trace, usually a string literal
+	export void Record(EventType type, const char* name, U64 id = 0)
+	{
+		auto& registry = GetRegistry();
+		auto buffer = GetThreadBuffer();
+		// Sequentially consistent with the dump setting paused, either it sees writing or this sees paused
+		buffer->writing.store(true, std::memory_order_seq_cst);
+		if (registry.paused.load(std::memory_order_seq_cst))
+		{
+			buffer->writing.store(false, std::memory_order_release);
+			return;
+		}
+		U64 index = buffer->written.load(std::memory_order_relaxed);
+		Event& event = buffer->events[index & (BufferCapacity - 1)];
+		event.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry.start).count();
+		event.name = name;
+		event.id = id;
+		event.type = type;
+		buffer->written.store(index + 1, std::memory_order_release);
+		buffer->writing.store(false, std::memory_order_release);
+	}
+
+	void AppendEscaped(std::string& out, const char* str)
+	{
+		for (; str && *str; str++)
+		{
+			if (*str == '"' || *str == '\\')
+			{
+				out.push_back('\\');
+			}
+			out.push_back(*str);
+		}
+	}
+
+	// Chrome trace event format, can be opened in chrome://tracing or ui.perfetto.dev
+	export std::string ToChromeTraceJSON()
+	{
+		auto& registry = GetRegistry();
+		std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		bool first = true;
+		auto separator = [&]()
+		{
+			if (!first)
+			{
+				out.push_back(',');
+			}
+			first = false;
+		};
+
+		registry.paused.store(true, std::memory_order_seq_cst);
+		{
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			for (auto& buffer : registry.buffers)
+			{
+				// Events started before the pause are finished first
+				while (buffer->writing.load(std::memory_order_acquire))
+				{
+					std::this_thread::yield();
+				}
+
+				auto tid = buffer->threadIndex;
+				separator();
+				auto threadName = tid == 0 ? std::string("Main") : tid < OtherThreadIndex ? fmt::format("Worker {}", tid) : fmt::format("Thread {}", tid - OtherThreadIndex);
+				fmt::format_to(std::back_inserter(out), R"({{"name":"thread_name","ph":"M","pid":0,"tid":{},"args":{{"name":"{}"}}}})", tid, threadName);
+
+				U64 written = buffer->written.load(std::memory_order_acquire);
+				U64 begin = written > BufferCapacity ? written - BufferCapacity : 0;
+				for (U64 i = begin; i < written; i++)
+				{
+					auto& event = buffer->events[i & (BufferCapacity - 1)];
+					double ts = event.timestamp / 1000.0;
+					const char* phase = "B";
+					const char* state = nullptr;
+					switch (event.type)
+					{
+						case EventType::Begin: state = "begin"; break;
+						case EventType::Resume: state = "resume"; break;
+						case EventType::Suspend: phase = "E"; state = "suspend"; break;
+						case EventType::End: phase = "E"; state = "end"; break;
+						case EventType::ZoneBegin: break;
+						case EventType::ZoneEnd: phase = "E"; break;
+					}
+
+					separator();
+					out += R"({"name":")";
+					AppendEscaped(out, event.name);
+					fmt::format_to(std::back_inserter(out), R"(","ph":"{}","ts":{:.3f},"pid":0,"tid":{})", phase, ts, tid);
+					if (state)
+					{
+						fmt::format_to(std::back_inserter(out), R"(,"cat":"job","args":{{"state":"{}","job":"{:#x}"}})", state, event.id);
+					}
+					out.push_back('}');
+
+					// Track the whole lifetime of a job across threads as an async span
+					if (event.type == EventType::Begin || event.type == EventType::End)
+					{
+						separator();
+						out += R"({"name":")";
+						AppendEscaped(out, event.name);
+						fmt::format_to(std::back_inserter(out), R"(","cat":"job","ph":"{}","id":"{:#x}","ts":{:.3f},"pid":0,"tid":{}}})",
+							event.type == EventType::Begin ? "b" : "e", event.id, ts, tid);
+					}
+				}
+			}
+		}
+		registry.paused.store(false, std::memory_order_release);
+
+		out += "]}";
+		return out;
+	}
+
+	export bool WriteChromeTrace(StringView path)
+	{
+		auto json = ToChromeTraceJSON();
+		auto file = IO::Open(path, IO::FileOpenMode::Write);
+		if (!file)
+		{
+			LOG_ERR("Can't write trace to {}", path.ToStringView());
+			return false;
+		}
+		bool success = IO::Write(file, reinterpret_cast<const U8*>(json.data()), json.size()) == json.size();
+		IO::Close(file);
+		return success;
+	}
+#else
+	export constexpr bool Enabled = false;
+
+	export inline void SetThreadIndex(unsigned int index) {}
+	export inline void Record(EventType type, const char* name, U64 id = 0) {}
+	export inline std::string ToChromeTraceJSON() { return {}; }
+	export inline bool WriteChromeTrace(StringView path) { return false; }
+#endif
+
+	// Records a named zone on the current thread for the lifetime of the scope
+	export class Scope
+	{
+	public:
+#ifdef TAKO_TRACE
+		Scope(const char* name) : m_name(name)
+		{
+			Record(EventType::ZoneBegin, m_name);
+		}
+
+		~Scope()
+		{
+			Record(EventType::ZoneEnd, m_name);
+		}
+	private:
+		const char* m_name;
+#else
+		Scope(const char* name) {}
+#endif
+	};
+}
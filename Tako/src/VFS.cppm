@@ -3,11 +3,25 @@ module;
 #include <vector>
 #include <memory>
 #include <span>
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <filesystem>
+#include <system_error>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <cctype>
 export module Tako.VFS;
 
 import Tako.NumberTypes;
 import Tako.StringView;
 import Tako.HandleVec;
+import Tako.Pack;
+import Tako.JobSystem;
+import Tako.IOQueue;
+import Tako.FlatHashMap;
 export import Tako.IO;
 
 namespace tako
@@ -17,16 +31,60 @@ namespace tako
         U64 value;
     };
 
+    export struct FileStat
+    {
+        U64 size = 0;
+        // Default for files in a pack
+        std::filesystem::file_time_type lastWrite;
+    };
+
+    // Visits every regular file below the mount path with its virtual path ("/dir/file.png").
+    // Errors end the scan instead of throwing, returns false if the directory couldn't be walked completely.
+    export template<typename Cb>
+    bool ScanMount(const std::string& mountPath, Cb&& callback)
+    {
+        std::error_code error;
+        std::filesystem::path root(mountPath);
+        std::filesystem::recursive_directory_iterator it(root, error);
+        for (; !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+        {
+            if (!it->is_regular_file(error))
+            {
+                continue;
+            }
+            auto virtualPath = "/" + it->path().lexically_relative(root).generic_string();
+            callback(*it, virtualPath);
+        }
+        return !error;
+    }
+
     struct FileHandleData
     {
-        IO::FileHandle* handle;
+        // Null for files served from a pack, those read from packData instead
+        IO::FileHandle* handle = nullptr;
+        IO::MappedFile packData;
+        size_t position = 0;
     };
 
     export class VFS
     {
     public:
+        VFS() : m_ioQueue(std::make_unique<IOQueue>())
+        {
+        }
+
         File Open(StringView path)
         {
+            if (auto packed = FindArchive(path))
+            {
+                FileHandleData entry;
+                entry.packData = packed->archive->Map(*packed->entry);
+                if (entry.packData.IsValid())
+                {
+                    return m_handles.Insert(std::move(entry));
+                }
+            }
+
             auto handle = OpenFilesystem(path);
             if (handle)
             {
@@ -41,61 +99,342 @@ namespace tako
         void Close(File file)
         {
             auto& entry = m_handles[file];
-            IO::Close(entry.handle);
+            if (entry.handle)
+            {
+                IO::Close(entry.handle);
+            }
             m_handles.Remove(file);
         }
 
         size_t Read(File file, U8* buffer, size_t size)
         {
             auto& entry = m_handles[file];
+            if (!entry.handle)
+            {
+                size_t count = std::min(size, entry.packData.GetSize() - entry.position);
+                if (count > 0)
+                {
+                    std::memcpy(buffer, entry.packData.GetData() + entry.position, count);
+                    entry.position += count;
+                }
+                return count;
+            }
             return IO::Read(entry.handle, buffer, size);
         }
 
+        // Positional read that leaves the position of the file alone, so workers can share one handle.
+        // Opening and closing files must not happen at the same time.
+        size_t ReadAt(File file, U64 offset, U8* buffer, size_t size)
+        {
+            auto& entry = m_handles[file];
+            if (!entry.handle)
+            {
+                if (offset >= entry.packData.GetSize())
+                {
+                    return 0;
+                }
+                size_t count = std::min<U64>(size, entry.packData.GetSize() - offset);
+                std::memcpy(buffer, entry.packData.GetData() + offset, count);
+                return count;
+            }
+            return IO::ReadAt(entry.handle, offset, buffer, size);
+        }
+
         size_t Write(File file, const U8* data, size_t size)
         {
             auto& entry = m_handles[file];
+            if (!entry.handle)
+            {
+                LOG_ERR("Files in a pack are read-only");
+                return 0;
+            }
             return IO::Write(entry.handle, data, size);
         }
 
         bool Seek(File file, long offset, IO::SeekOrigin origin)
         {
             auto& entry = m_handles[file];
+            if (!entry.handle)
+            {
+                long base = 0;
+                switch (origin)
+                {
+                    case IO::SeekOrigin::Start: base = 0; break;
+                    case IO::SeekOrigin::Current: base = static_cast<long>(entry.position); break;
+                    case IO::SeekOrigin::End: base = static_cast<long>(entry.packData.GetSize()); break;
+                }
+                long target = base + offset;
+                if (target < 0 || static_cast<size_t>(target) > entry.packData.GetSize())
+                {
+                    return false;
+                }
+                entry.position = static_cast<size_t>(target);
+                return true;
+            }
             return IO::Seek(entry.handle, offset, origin);
         }
 
         size_t Tell(File file)
         {
             auto& entry = m_handles[file];
+            if (!entry.handle)
+            {
+                return entry.position;
+            }
             return IO::Tell(entry.handle);
         }
 
         std::string LoadText(StringView path)
         {
-            auto file = OpenFilesystem(path);
-            ASSERT(file);
-            auto fileSize = GetSizeFilesystem(file);
-            IO::Seek(file, 0, IO::SeekOrigin::Start);
-            std::string str(fileSize, '\0');
-            IO::Read(file, reinterpret_cast<U8*>(str.data()), str.size());
-            IO::Close(file);
-            return str;
+            auto file = Map(path);
+            ASSERT(file.IsValid());
+            return std::string(reinterpret_cast<const char*>(file.GetData()), file.GetSize());
         }
 
         std::vector<U8> LoadFile(StringView path) const
         {
-            auto file = OpenFilesystem(path);
-            ASSERT(file);
-            auto fileSize = GetSizeFilesystem(file);
-            IO::Seek(file, 0, IO::SeekOrigin::Start);
-            std::vector<U8> buffer(fileSize);
-            IO::Read(file, reinterpret_cast<U8*>(buffer.data()), buffer.size());
-            IO::Close(file);
-            return buffer;
+            auto file = Map(path);
+            ASSERT(file.IsValid());
+            return std::vector<U8>(file.GetData(), file.GetData() + file.GetSize());
+        }
+
+        // Sequential reader without a handle lookup per read, served straight from the pack mapping where possible
+        IO::StreamReader OpenStream(StringView path, size_t bufferSize = IO::DefaultStreamBufferSize) const
+        {
+            if (auto packed = FindArchive(path))
+            {
+                auto file = packed->archive->Map(*packed->entry);
+                return file.IsValid() ? IO::StreamReader::FromMapped(std::move(file)) : IO::StreamReader();
+            }
+
+            ASSERT(m_mountPaths.size() > 0 || m_archives.size() > 0);
+            if (auto resolved = Resolve(path))
+            {
+                return IO::OpenStream(*resolved, bufferSize);
+            }
+            if (IsIndexFinal())
+            {
+                return {};
+            }
+
+            std::string adjustedPath;
+            for (auto& mountPath : m_mountPaths)
+            {
+                adjustedPath = mountPath;
+                adjustedPath.append(path);
+                auto stream = IO::OpenStream(adjustedPath, bufferSize);
+                if (stream.IsValid())
+                {
+                    return stream;
+                }
+            }
+            return {};
+        }
+
+        // Reads on an IO thread and resumes on the JobSystem, the result is empty if the file couldn't be read.
+        // The path is taken by value since the task runs after the caller's buffer may be gone.
+        Task<std::vector<U8>> LoadFileAsync(std::string path)
+        {
+            std::vector<U8> data;
+            AsyncLatch latch;
+            m_ioQueue->Submit([&]()
+            {
+                data = TryLoadFile(path);
+            }, latch);
+            co_await latch;
+            co_return std::move(data);
+        }
+
+        // Batched LoadFileAsync, all reads are queued at once and the results keep the order of paths
+        Task<std::vector<std::vector<U8>>> LoadFilesAsync(std::vector<std::string> paths)
+        {
+            std::vector<std::vector<U8>> results(paths.size());
+            std::vector<IOQueue::Work> batch;
+            batch.reserve(paths.size());
+            for (size_t i = 0; i < paths.size(); i++)
+            {
+                batch.push_back([&, i]()
+                {
+                    results[i] = TryLoadFile(paths[i]);
+                });
+            }
+            AsyncLatch latch(paths.size());
+            m_ioQueue->Submit(batch, latch);
+            co_await latch;
+            co_return std::move(results);
+        }
+
+        // Read-only view of the whole file, decode from it directly instead of copying it with LoadFile.
+        // Views into a pack stay valid for as long as the VFS.
+        IO::MappedFile Map(StringView path) const
+        {
+            if (auto packed = FindArchive(path))
+            {
+                return packed->archive->Map(*packed->entry);
+            }
+
+            ASSERT(m_mountPaths.size() > 0 || m_archives.size() > 0);
+            if (auto resolved = Resolve(path))
+            {
+                return IO::Map(*resolved);
+            }
+            if (IsIndexFinal())
+            {
+                return {};
+            }
+
+            std::string adjustedPath;
+            for (auto& mountPath : m_mountPaths)
+            {
+                adjustedPath = mountPath;
+                adjustedPath.append(path);
+                auto file = IO::Map(adjustedPath);
+                if (file.IsValid())
+                {
+                    return file;
+                }
+            }
+
+            return {};
+        }
+
+        // Answered from the packs and the mount index, misses only touch the filesystem while no watcher keeps the index current
+        bool Exists(StringView path) const
+        {
+            return Stat(path).has_value();
+        }
+
+        std::optional<FileStat> Stat(StringView path) const
+        {
+            if (auto packed = FindArchive(path))
+            {
+                return FileStat{ packed->entry->size };
+            }
+            std::shared_lock lock(m_indexMutex);
+            if (auto indexed = FindIndexed(path))
+            {
+                return indexed->stat;
+            }
+            if (IsIndexFinal())
+            {
+                return std::nullopt;
+            }
+            lock.unlock();
+
+            // Not indexed or possibly created since, look it up the slow way
+            std::string adjustedPath;
+            for (auto& mountPath : m_mountPaths)
+            {
+                adjustedPath = mountPath;
+                adjustedPath.append(path);
+                std::error_code error;
+                auto size = std::filesystem::file_size(adjustedPath, error);
+                if (!error)
+                {
+                    return FileStat{ size, std::filesystem::last_write_time(adjustedPath, error) };
+                }
+            }
+            return std::nullopt;
         }
 
+        // Indexes every file below the path, files of later mounts take priority
         void AddMountPath(StringView path)
         {
             m_mountPaths.insert(m_mountPaths.begin(), path.ToString());
+            auto& mountPath = m_mountPaths.front();
+            std::unique_lock lock(m_indexMutex);
+            size_t count = 0;
+            bool complete = ScanMount(mountPath, [&](const std::filesystem::directory_entry& file, const std::string& virtualPath)
+            {
+                std::error_code error;
+                IndexEntry entry;
+                entry.realPath = mountPath + virtualPath;
+                entry.stat.size = file.file_size(error);
+                entry.stat.lastWrite = file.last_write_time(error);
+                m_index.insert_or_assign(IndexKey(virtualPath), std::move(entry));
+                count++;
+            });
+            if (!complete)
+            {
+                LOG_WARN("Could not index mount path {}, falling back to probing it", mountPath);
+                m_indexComplete = false;
+            }
+            LOG("Indexed {} files in {}", count, mountPath);
+        }
+
+        // Re-resolves a single file after it was created, changed or deleted, called by the FileWatcher
+        void UpdateIndex(StringView path)
+        {
+            std::optional<IndexEntry> found;
+            std::string adjustedPath;
+            for (auto& mountPath : m_mountPaths)
+            {
+                adjustedPath = mountPath;
+                adjustedPath.append(path);
+                std::error_code error;
+                auto size = std::filesystem::file_size(adjustedPath, error);
+                if (!error)
+                {
+                    found = IndexEntry{ adjustedPath, { size, std::filesystem::last_write_time(adjustedPath, error) } };
+                    break;
+                }
+            }
+
+            std::unique_lock lock(m_indexMutex);
+            if (found)
+            {
+                m_index.insert_or_assign(IndexKey(path), std::move(*found));
+            }
+            else
+            {
+                m_index.erase(IndexKey(path));
+            }
+        }
+
+        // Virtual paths of every indexed file below a directory, e.g. to update them after the directory was removed
+        std::vector<std::string> GetIndexedFiles(StringView directory) const
+        {
+            std::string prefix = IndexKey(directory);
+            if (!prefix.ends_with('/'))
+            {
+                prefix += '/';
+            }
+            std::vector<std::string> paths;
+            std::shared_lock lock(m_indexMutex);
+            for (auto& [path, entry] : m_index)
+            {
+                if (path.starts_with(prefix))
+                {
+                    paths.push_back(path);
+                }
+            }
+            return paths;
+        }
+
+        // While a watcher keeps the index current through UpdateIndex, a miss in it is final.
+        // Without one, files created after indexing are still found by probing the mounts.
+        void AttachWatcher()
+        {
+            m_watchers.fetch_add(1);
+        }
+
+        void DetachWatcher()
+        {
+            ASSERT(m_watchers.load() > 0);
+            m_watchers.fetch_sub(1);
+        }
+
+        // Packs are searched before the mount paths, the most recently added one first
+        bool AddMountArchive(StringView path)
+        {
+            auto archive = std::make_unique<PackArchive>();
+            if (!archive->Open(path))
+            {
+                return false;
+            }
+            LOG("Mounted pack {} with {} files", path.ToStringView(), archive->GetEntries().size());
+            m_archives.insert(m_archives.begin(), std::move(archive));
+            return true;
         }
 
 		std::span<std::string> GetMountPaths()
@@ -104,11 +443,103 @@ namespace tako
 		}
     private:
         std::vector<std::string> m_mountPaths;
-        tako::HandleVec<File, FileHandleData> m_handles;
+        std::vector<std::unique_ptr<PackArchive>> m_archives;
+        tako::SlotMap<File, FileHandleData> m_handles;
+
+        struct IndexEntry
+        {
+            // Path on disk in the mount that wins for this file
+            std::string realPath;
+            FileStat stat;
+        };
+
+        // Virtual path to the file it resolves to, so lookups don't probe every mount
+        FlatHashMap<std::string, IndexEntry> m_index;
+        mutable std::shared_mutex m_indexMutex;
+        // False if a mount couldn't be scanned, a miss in the index then has to be checked on disk
+        bool m_indexComplete = true;
+        std::atomic<int> m_watchers = 0;
+        // Last, so it's destroyed first and drains queued reads while everything they touch still exists
+        std::unique_ptr<IOQueue> m_ioQueue;
+
+        bool IsIndexFinal() const
+        {
+            return m_indexComplete && m_watchers.load(std::memory_order_relaxed) > 0;
+        }
+
+        // Lowercase where the filesystem ignores case, so the index matches paths the way the OS would
+        static std::string IndexKey(StringView path)
+        {
+            std::string key = path.ToString();
+#if defined(TAKO_WINDOWS) || defined(TAKO_MAC)
+            std::transform(key.begin(), key.end(), key.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+#endif
+            return key;
+        }
+
+        // m_indexMutex has to be held
+        const IndexEntry* FindIndexed(StringView path) const
+        {
+#if defined(TAKO_WINDOWS) || defined(TAKO_MAC)
+            auto it = m_index.find(IndexKey(path));
+#else
+            auto it = m_index.find(path.ToStringView());
+#endif
+            return it != m_index.end() ? &it->second : nullptr;
+        }
+
+        std::optional<std::string> Resolve(StringView path) const
+        {
+            std::shared_lock lock(m_indexMutex);
+            auto indexed = FindIndexed(path);
+            if (!indexed)
+            {
+                return std::nullopt;
+            }
+            return indexed->realPath;
+        }
+
+        struct ArchiveEntry
+        {
+            const PackArchive* archive;
+            const PackEntry* entry;
+        };
+
+        std::optional<ArchiveEntry> FindArchive(StringView path) const
+        {
+            for (auto& archive : m_archives)
+            {
+                if (auto entry = archive->Find(path.ToStringView()))
+                {
+                    return ArchiveEntry{ archive.get(), entry };
+                }
+            }
+            return std::nullopt;
+        }
+
+        std::vector<U8> TryLoadFile(StringView path) const
+        {
+            auto file = Map(path);
+            if (!file.IsValid())
+            {
+                LOG_ERR("Could not load {}", path.ToStringView());
+                return {};
+            }
+            return std::vector<U8>(file.GetData(), file.GetData() + file.GetSize());
+        }
 
         IO::FileHandle* OpenFilesystem(StringView path) const
         {
-            ASSERT(m_mountPaths.size() > 0);
+            ASSERT(m_mountPaths.size() > 0 || m_archives.size() > 0);
+            if (auto resolved = Resolve(path))
+            {
+                return IO::Open(*resolved);
+            }
+            if (IsIndexFinal())
+            {
+                return nullptr;
+            }
+
             std::string adjustedPath;
             for (auto& mountPath : m_mountPaths)
             {
@@ -123,11 +554,5 @@ namespace tako
 
             return nullptr;
         }
-
-        static size_t GetSizeFilesystem(IO::FileHandle* file)
-        {
-            IO::Seek(file, 0, IO::SeekOrigin::End);
-            return IO::Tell(file);
-        }
     };
 }
\ No newline at end of file
@@ -1,6 +1,22 @@
 module;
 #include "Utility.hpp"
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
+#if defined(TAKO_WINDOWS)
+#include <io.h>
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <cerrno>
+#endif
+#if defined(TAKO_LINUX) || defined(TAKO_MAC)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 module Tako.IO;
 
 namespace tako::IO
@@ -37,11 +53,225 @@ namespace tako::IO
 
     bool Seek(FileHandle* file, long offset, SeekOrigin origin)
     {
-        return fseek(static_cast<FILE*>(file), offset, static_cast<int>(origin));
+        return fseek(static_cast<FILE*>(file), offset, static_cast<int>(origin)) == 0;
     }
 
     size_t Tell(FileHandle* file)
     {
         return ftell(static_cast<FILE*>(file));
     }
+
+    size_t ReadAt(FileHandle* file, U64 offset, U8* buffer, size_t size)
+    {
+        size_t total = 0;
+#if defined(TAKO_WINDOWS)
+        HANDLE handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(static_cast<FILE*>(file))));
+        while (total < size)
+        {
+            OVERLAPPED overlapped = {};
+            U64 position = offset + total;
+            overlapped.Offset = static_cast<DWORD>(position);
+            overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+            DWORD chunk = static_cast<DWORD>(std::min<size_t>(size - total, 1u << 30));
+            DWORD bytesRead = 0;
+            if (!ReadFile(handle, buffer + total, chunk, &bytesRead, &overlapped) || bytesRead == 0)
+            {
+                break;
+            }
+            total += bytesRead;
+        }
+#else
+        int fd = fileno(static_cast<FILE*>(file));
+        while (total < size)
+        {
+            auto bytesRead = pread(fd, buffer + total, size - total, offset + total);
+            if (bytesRead < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytesRead <= 0)
+            {
+                break;
+            }
+            total += bytesRead;
+        }
+#endif
+        return total;
+    }
+
+    StreamReader OpenStream(StringView filePath, size_t bufferSize)
+    {
+#if defined(TAKO_LINUX) || defined(TAKO_MAC)
+        auto file = Map(filePath);
+        if (file.IsValid())
+        {
+            return StreamReader::FromMapped(std::move(file));
+        }
+        return {};
+#else
+        auto handle = Open(filePath);
+        if (!handle)
+        {
+            return {};
+        }
+        return StreamReader::FromHandle(handle, bufferSize);
+#endif
+    }
+
+    std::span<const U8> StreamReader::Read(size_t size)
+    {
+        if (!m_file)
+        {
+            size = std::min<U64>(size, m_mapped.GetSize() - m_position);
+            std::span<const U8> window(m_mapped.GetData() + m_position, size);
+            m_position += size;
+            return window;
+        }
+
+        size = std::min(size, m_capacity);
+        if (m_end - m_begin < size && !m_eof)
+        {
+            Fill();
+        }
+        size = std::min(size, m_end - m_begin);
+        std::span<const U8> window(m_buffer.get() + m_begin, size);
+        m_begin += size;
+        return window;
+    }
+
+    std::span<const U8> StreamReader::ReadChunk(size_t maxSize)
+    {
+        if (m_file && m_begin == m_end && !m_eof)
+        {
+            Fill();
+        }
+        size_t available = m_file ? m_end - m_begin : m_mapped.GetSize() - m_position;
+        return Read(std::min(maxSize, available));
+    }
+
+    void StreamReader::Skip(U64 count)
+    {
+        if (!m_file)
+        {
+            m_position += std::min<U64>(count, m_mapped.GetSize() - m_position);
+            return;
+        }
+
+        size_t buffered = m_end - m_begin;
+        if (count <= buffered)
+        {
+            m_begin += count;
+            return;
+        }
+        // Past the buffer, the next read starts at the new offset
+        m_fileOffset += count - buffered;
+        m_begin = m_end = 0;
+    }
+
+    bool StreamReader::AtEnd()
+    {
+        if (!m_file)
+        {
+            return m_position == m_mapped.GetSize();
+        }
+        if (m_begin == m_end && !m_eof)
+        {
+            Fill();
+        }
+        return m_begin == m_end;
+    }
+
+    void StreamReader::Fill()
+    {
+        size_t buffered = m_end - m_begin;
+        std::memmove(m_buffer.get(), m_buffer.get() + m_begin, buffered);
+        m_begin = 0;
+        m_end = buffered;
+        size_t requested = m_capacity - m_end;
+        size_t bytesRead = ReadAt(m_file, m_fileOffset, m_buffer.get() + m_end, requested);
+        m_end += bytesRead;
+        m_fileOffset += bytesRead;
+        // ReadAt only comes up short at the end of the file
+        m_eof = bytesRead < requested;
+    }
+
+    MappedFile Map(StringView filePath)
+    {
+        CStringBuffer pathBuffer(filePath);
+        MappedFile file;
+#if defined(TAKO_LINUX) || defined(TAKO_MAC)
+        int fd = open(pathBuffer.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return file;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            return file;
+        }
+        if (info.st_size == 0)
+        {
+            close(fd);
+            file.m_storage = MappedFile::Storage::Empty;
+            return file;
+        }
+        // The mapping stays valid after closing the descriptor
+        void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+        {
+            LOG_ERR("Could not map file {}", pathBuffer.c_str());
+            return file;
+        }
+        // Loaders decode the whole file front to back
+        madvise(data, info.st_size, MADV_WILLNEED);
+        file.m_data = static_cast<const U8*>(data);
+        file.m_size = info.st_size;
+        file.m_storage = MappedFile::Storage::Mapped;
+#else
+        auto handle = Open(filePath);
+        if (!handle)
+        {
+            return file;
+        }
+        Seek(handle, 0, SeekOrigin::End);
+        size_t size = Tell(handle);
+        Seek(handle, 0, SeekOrigin::Start);
+        if (size == 0)
+        {
+            Close(handle);
+            file.m_storage = MappedFile::Storage::Empty;
+            return file;
+        }
+        U8* data = new U8[size];
+        size_t bytesRead = Read(handle, data, size);
+        Close(handle);
+        file.m_data = data;
+        file.m_size = bytesRead;
+        file.m_storage = MappedFile::Storage::Owned;
+#endif
+        return file;
+    }
+
+    void MappedFile::Release()
+    {
+        switch (m_storage)
+        {
+            case Storage::Mapped:
+#if defined(TAKO_LINUX) || defined(TAKO_MAC)
+                munmap(const_cast<U8*>(m_data), m_size);
+#endif
+                break;
+            case Storage::Owned:
+                delete[] m_data;
+                break;
+            default:
+                break;
+        }
+        m_data = nullptr;
+        m_size = 0;
+        m_storage = Storage::None;
+    }
 }
\ No newline at end of file
@@ -118,6 +118,15 @@ namespace tako
 		wgpu::Texture texture;
 		wgpu::TextureView view;
 		wgpu::Extent3D size;
+		// Bind groups referencing the view, rebuilt when the texture is recreated at another size
+		std::vector<ShaderBinding> bindings;
+	};
+
+	struct ShaderBindingEntry
+	{
+		wgpu::BindGroup group;
+		ShaderBindingLayout layout;
+		std::vector<ShaderBindingEntryData> entries;
 	};
 
 	struct PipelineEntry
@@ -362,7 +371,7 @@ namespace tako
 
 		void Bind(const ShaderBinding binding, const U32 slot) override
 		{
-			auto& bindGroup = m_shaderBindings[binding];
+			auto& bindGroup = m_shaderBindings[binding].group;
 			wgpuRenderPassEncoderSetBindGroup(m_renderPass, slot, bindGroup.Get(), 0, nullptr);
 		}
 
@@ -517,7 +526,7 @@ namespace tako
 			pipelineDesc.multisample.alphaToCoverageEnabled = false;
 
 			PipelineEntry pipelineEntry;
-			std::vector<wgpu::BindGroupLayout> layouts; //TODO: Use SmallVec
+			SmallVec<wgpu::BindGroupLayout, 4> layouts;
 			for (auto& binding : pipelineDescriptor.shaderBindings)
 			{
 				wgpu::BindGroupLayout layout = CreateBindingLayout(binding);
@@ -566,6 +575,19 @@ namespace tako
 		void UpdateTexture(Texture texture, const ImageView image) override
 		{
 			auto& entry = m_textures[texture];
+			if (entry.size.width != image.GetWidth() || entry.size.height != image.GetHeight())
+			{
+				// Keeps the handle, the bind groups holding the old view have to pick up the new one
+				auto bindings = std::move(entry.bindings);
+				entry = CreateTextureEntry(std::span<const ImageView>{&image, 1}, wgpu::TextureDimension::e2D, wgpu::TextureViewDimension::e2D);
+				entry.bindings = std::move(bindings);
+				for (auto binding : entry.bindings)
+				{
+					auto& bindingEntry = m_shaderBindings[binding];
+					bindingEntry.group = CreateBindGroup(bindingEntry.layout, bindingEntry.entries);
+				}
+				return;
+			}
 			WriteTexture(entry, image);
 		}
 
@@ -646,46 +668,32 @@ namespace tako
 
 		ShaderBinding CreateShaderBinding(ShaderBindingLayout layout, std::span<ShaderBindingEntryData> entries) override
 		{
-			std::vector<wgpu::BindGroupEntry> bindings;
-			for (size_t i = 0; i < entries.size(); i++)
+			ShaderBindingEntry bindingEntry;
+			bindingEntry.group = CreateBindGroup(layout, entries);
+			bindingEntry.layout = layout;
+			bindingEntry.entries.assign(entries.begin(), entries.end());
+			auto binding = m_shaderBindings.Insert(std::move(bindingEntry));
+			for (auto& data : entries)
 			{
-				auto& binding = bindings.emplace_back();
-				binding.nextInChain = nullptr;
-				binding.binding = i;
-
-				std::visit(overloaded
+				if (auto texture = std::get_if<Texture>(&data))
 				{
-					[&](const Buffer buffer)
-					{
-						binding.buffer = wgpu::Buffer(reinterpret_cast<WGPUBuffer>(buffer.value));
-						binding.offset = 0;
-						//TODO: size?
-					},
-					[&](const Texture texture)
-					{
-						auto& textures = m_textures;
-						auto& entry = m_textures[texture];
-						binding.textureView = entry.view;
-					},
-					[&](const Sampler sampler)
-					{
-						binding.sampler = m_samplers[sampler];
-					}
-				}, entries[i]);
+					m_textures[*texture].bindings.push_back(binding);
+				}
 			}
-
-			wgpu::BindGroupDescriptor bindGroupDesc{};
-			bindGroupDesc.nextInChain = nullptr;
-			bindGroupDesc.layout = m_shaderBindingLayouts[layout];
-
-			bindGroupDesc.entryCount = bindings.size();;
-			bindGroupDesc.entries = bindings.data();
-			auto shaderBinding = m_device.CreateBindGroup(&bindGroupDesc);
-			return m_shaderBindings.Insert(std::move(shaderBinding));
+			return binding;
 		}
 
 		void ReleaseShaderBinding(ShaderBinding binding) override
 		{
+			for (auto& data : m_shaderBindings[binding].entries)
+			{
+				auto texture = std::get_if<Texture>(&data);
+				// The texture may have been released first
+				if (auto entry = texture ? m_textures.TryGet(*texture) : nullptr)
+				{
+					std::erase_if(entry->bindings, [&](ShaderBinding b) { return b.value == binding.value; });
+				}
+			}
 			m_shaderBindings.Remove(binding);
 		}
 
@@ -727,7 +735,7 @@ namespace tako
 		HandleVec<Sampler, wgpu::Sampler> m_samplers;
 		HandleVec<Pipeline, PipelineEntry> m_pipelines;
 		HandleVec<ShaderBindingLayout, wgpu::BindGroupLayout> m_shaderBindingLayouts;
-		HandleVec<ShaderBinding, wgpu::BindGroup> m_shaderBindings;
+		HandleVec<ShaderBinding, ShaderBindingEntry> m_shaderBindings;
 
 		wgpu::BindGroupLayout m_modelLayout;
 		InstanceBuffer m_instanceBuffer;
@@ -918,6 +926,45 @@ namespace tako
 			return targetView;
 		}
 
+		wgpu::BindGroup CreateBindGroup(ShaderBindingLayout layout, std::span<const ShaderBindingEntryData> entries)
+		{
+			std::vector<wgpu::BindGroupEntry> bindings;
+			for (size_t i = 0; i < entries.size(); i++)
+			{
+				auto& binding = bindings.emplace_back();
+				binding.nextInChain = nullptr;
+				binding.binding = i;
+
+				std::visit(overloaded
+				{
+					[&](const Buffer buffer)
+					{
+						binding.buffer = wgpu::Buffer(reinterpret_cast<WGPUBuffer>(buffer.value));
+						binding.offset = 0;
+						//TODO: size?
+					},
+					[&](const Texture texture)
+					{
+						auto& textures = m_textures;
+						auto& entry = m_textures[texture];
+						binding.textureView = entry.view;
+					},
+					[&](const Sampler sampler)
+					{
+						binding.sampler = m_samplers[sampler];
+					}
+				}, entries[i]);
+			}
+
+			wgpu::BindGroupDescriptor bindGroupDesc{};
+			bindGroupDesc.nextInChain = nullptr;
+			bindGroupDesc.layout = m_shaderBindingLayouts[layout];
+
+			bindGroupDesc.entryCount = bindings.size();;
+			bindGroupDesc.entries = bindings.data();
+			return m_device.CreateBindGroup(&bindGroupDesc);
+		}
+
 		void WriteTexture(TextureEntry& entry, const ImageView& image, unsigned int i = 0)
 		{
 			auto width = image.GetWidth();
@@ -944,6 +991,11 @@ namespace tako
 		}
 
 		Texture CreateWGPUTexture(const std::span<const ImageView> images, wgpu::TextureDimension dimension, wgpu::TextureViewDimension viewDimension)
+		{
+			return m_textures.Insert(CreateTextureEntry(images, dimension, viewDimension));
+		}
+
+		TextureEntry CreateTextureEntry(const std::span<const ImageView> images, wgpu::TextureDimension dimension, wgpu::TextureViewDimension viewDimension)
 		{
 			ASSERT(images.size() > 0);
 			// Assume all images are the same dimensions
@@ -1000,7 +1052,7 @@ namespace tako
 			entry.view = entry.texture.CreateView(&textureViewDesc);
 			ASSERT(entry.view);
 
-			return m_textures.Insert(std::move(entry));
+			return entry;
 		}
 
 		WGPUBuffer CreateWGPUBuffer(WGPUBufferUsage bufferType, const void* bufferData, size_t dataSize)
@@ -0,0 +1,92 @@
+#define TAKO_FORCE_LOG
+#include "Utility.hpp"
+#include "BenchUtil.hpp"
+#include <thread>
+#include <barrier>
+#include <vector>
+#include <random>
+#include <cstdlib>
+
+import Tako.Allocators.SizeClassAllocator;
+
+constexpr auto REPEAT_COUNT = 10;
+constexpr auto OPERATION_COUNT = 1000000;
+constexpr auto LIVE_COUNT = 1024;
+constexpr auto MAX_SIZE = 1024;
+
+struct Allocation
+{
+	void* ptr;
+	size_t size;
+};
+
+// Every thread keeps a working set of allocations and randomly replaces them.
+// The threads live for all repeats, so their caches are warm after the first one.
+template<typename Alloc, typename Free>
+void RunThreaded(std::string_view name, unsigned int threadCount, Alloc alloc, Free dealloc)
+{
+	std::barrier sync(threadCount + 1);
+	std::vector<std::thread> threads;
+	for (unsigned int t = 0; t < threadCount; t++)
+	{
+		threads.emplace_back([&, t]()
+		{
+			std::mt19937 rng(t);
+			for (int r = 0; r < REPEAT_COUNT; r++)
+			{
+				sync.arrive_and_wait();
+				std::vector<Allocation> live(LIVE_COUNT);
+				for (auto& a : live)
+				{
+					a.size = 1 + rng() % MAX_SIZE;
+					a.ptr = alloc(a.size);
+				}
+				for (int i = 0; i < OPERATION_COUNT; i++)
+				{
+					auto& a = live[rng() % LIVE_COUNT];
+					dealloc(a.ptr, a.size);
+					a.size = 1 + rng() % MAX_SIZE;
+					a.ptr = alloc(a.size);
+					*reinterpret_cast<char*>(a.ptr) = char(i);
+				}
+				for (auto& a : live)
+				{
+					dealloc(a.ptr, a.size);
+				}
+				sync.arrive_and_wait();
+			}
+		});
+	}
+
+	double timeSum = 0;
+	Timer timer;
+	for (int r = 0; r < REPEAT_COUNT; r++)
+	{
+		timer.Start();
+		sync.arrive_and_wait();
+		sync.arrive_and_wait();
+		timeSum += timer.Stop();
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	LOG("{} ({} threads): {}", name, threadCount, timeSum / REPEAT_COUNT);
+}
+
+int main()
+{
+	unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int threadCount = 1; threadCount <= maxThreads; threadCount *= 2)
+	{
+		RunThreaded("malloc", threadCount,
+			[](size_t size) { return malloc(size); },
+			[](void* p, size_t size) { free(p); });
+
+		tako::Allocators::SizeClassAllocator allocator;
+		RunThreaded("SizeClassAllocator", threadCount,
+			[&](size_t size) { return allocator.Allocate(size); },
+			[&](void* p, size_t size) { allocator.Deallocate(p, size); });
+	}
+}
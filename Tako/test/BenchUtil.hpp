@@ -0,0 +1,67 @@
+#pragma once
+#include "Utility.hpp"
+#include <chrono>
+#include <string_view>
+#include <type_traits>
+
+// Timing helpers for the benchmarks besides ECSBench, which keeps its own
+class Timer
+{
+public:
+	Timer()
+	{
+		Start();
+	}
+
+	void Start()
+	{
+		m_start = std::chrono::high_resolution_clock::now();
+	}
+
+	double Stop()
+	{
+		auto endTime = std::chrono::high_resolution_clock::now();
+
+		auto start = std::chrono::time_point_cast<std::chrono::microseconds>(m_start).time_since_epoch().count();
+		auto end = std::chrono::time_point_cast<std::chrono::microseconds>(endTime).time_since_epoch().count();
+		auto duration = end - start;
+		return duration * 0.001;
+	}
+private:
+	std::chrono::time_point<std::chrono::high_resolution_clock> m_start;
+};
+
+// Average milliseconds per call, a callback taking an argument gets a function that restarts the timer to leave out its setup
+template<typename Cb>
+double TimeRepeated(int repeatCount, Cb& callback)
+{
+	double timeSum = 0;
+	Timer timer;
+	auto restart = [&]{ timer.Start(); };
+	for (int i = 0; i < repeatCount; i++)
+	{
+		timer.Start();
+		if constexpr (std::is_invocable_v<Cb&, decltype(restart)>)
+		{
+			callback(restart);
+		}
+		else
+		{
+			callback();
+		}
+		timeSum += timer.Stop();
+	}
+	return timeSum / repeatCount;
+}
+
+template<typename Cb>
+void RunTimed(std::string_view name, int repeatCount, Cb callback)
+{
+	LOG("{}: {}", name, TimeRepeated(repeatCount, callback));
+}
+
+template<typename Cb>
+void RunTimed(std::string_view name, size_t elements, int repeatCount, Cb callback)
+{
+	LOG("{} ({} elements): {}", name, elements, TimeRepeated(repeatCount, callback));
+}
@@ -0,0 +1,97 @@
+#define TAKO_FORCE_LOG
+#include "Utility.hpp"
+#include "BenchUtil.hpp"
+#include "NumberTypes.hpp"
+#include <chrono>
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <random>
+#include <algorithm>
+
+import Tako.FlatHashMap;
+
+constexpr auto REPEAT_COUNT = 20;
+
+template<typename Map, typename Key>
+void RunMap(std::string_view name, const std::vector<Key>& keys, const std::vector<Key>& missing, size_t& sum)
+{
+	std::string label(name);
+	RunTimed(label + " Insert", keys.size(), REPEAT_COUNT, [&]()
+	{
+		Map map;
+		for (size_t i = 0; i < keys.size(); i++)
+		{
+			map[keys[i]] = i;
+		}
+		sum += map.size();
+	});
+
+	Map map;
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		map[keys[i]] = i;
+	}
+
+	RunTimed(label + " Lookup hit", keys.size(), REPEAT_COUNT, [&]()
+	{
+		for (auto& key : keys)
+		{
+			sum += map.find(key)->second;
+		}
+	});
+
+	RunTimed(label + " Lookup miss", keys.size(), REPEAT_COUNT, [&]()
+	{
+		for (auto& key : missing)
+		{
+			sum += map.find(key) == map.end();
+		}
+	});
+
+	RunTimed(label + " Iterate", keys.size(), REPEAT_COUNT, [&]()
+	{
+		for (auto& [key, value] : map)
+		{
+			sum += value;
+		}
+	});
+}
+
+// Keys are shuffled, lookups in insertion order would flatter the node based containers
+template<size_t N>
+void RunSize(size_t& sum)
+{
+	std::mt19937_64 rng(N);
+	std::vector<tako::U64> intKeys;
+	std::vector<tako::U64> intMissing;
+	std::vector<std::string> strKeys;
+	std::vector<std::string> strMissing;
+	for (size_t i = 0; i < N; i++)
+	{
+		intKeys.push_back(i * 64);
+		intMissing.push_back(i * 64 + 1);
+		strKeys.push_back("Assets/Textures/texture_" + std::to_string(i) + ".png");
+		strMissing.push_back("Assets/Models/model_" + std::to_string(i) + ".glb");
+	}
+	std::shuffle(intKeys.begin(), intKeys.end(), rng);
+	std::shuffle(strKeys.begin(), strKeys.end(), rng);
+
+	RunMap<std::map<tako::U64, size_t>>("std::map U64", intKeys, intMissing, sum);
+	RunMap<std::unordered_map<tako::U64, size_t>>("std::unordered_map U64", intKeys, intMissing, sum);
+	RunMap<tako::FlatHashMap<tako::U64, size_t>>("FlatHashMap U64", intKeys, intMissing, sum);
+
+	RunMap<std::map<std::string, size_t>>("std::map string", strKeys, strMissing, sum);
+	RunMap<std::unordered_map<std::string, size_t>>("std::unordered_map string", strKeys, strMissing, sum);
+	RunMap<tako::FlatHashMap<std::string, size_t>>("FlatHashMap string", strKeys, strMissing, sum);
+}
+
+int main()
+{
+	size_t sum = 0;
+	RunSize<64>(sum);
+	RunSize<1024>(sum);
+	RunSize<65536>(sum);
+	LOG("{}", sum);
+}
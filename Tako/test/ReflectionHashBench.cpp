@@ -0,0 +1,76 @@
+#define TAKO_FORCE_LOG
+#include "Utility.hpp"
+#include "BenchUtil.hpp"
+#include "NumberTypes.hpp"
+#include <chrono>
+#include <memory>
+#include <string>
+
+import Tako.Math;
+import Tako.CSG;
+import Tako.Hash;
+import Tako.Hash.Reflection;
+import Tako.Serialization;
+
+constexpr auto REPEAT_COUNT = 100;
+
+// A brush tree like the level editor builds, alternating box and sphere brushes
+std::unique_ptr<tako::CSG::CSGBrush> BuildTree(int depth, int width)
+{
+	using namespace tako::CSG;
+	auto combiner = std::make_unique<CSGCombiner>();
+	for (int i = 0; i < width; i++)
+	{
+		CSGCombinerNode node;
+		if (depth > 0)
+		{
+			node.node = BuildTree(depth - 1, width);
+		}
+		else if (i % 2 == 0)
+		{
+			node.node = std::make_unique<BoxBrush>(float(i), 1.0f, 2.0f);
+		}
+		else
+		{
+			auto sphere = std::make_unique<SphereBrush>();
+			sphere->radius = float(i);
+			node.node = std::move(sphere);
+		}
+		node.operation = i % 3 == 0 ? CSGOperation::Subtraction : CSGOperation::Union;
+		node.transform.position = { float(i), float(depth), 0 };
+		combiner->nodes.push_back(std::move(node));
+	}
+	return combiner;
+}
+
+void RunTree(int depth, int width, size_t& sum)
+{
+	tako::CSG::CSGCombinerNode root;
+	root.node = BuildTree(depth, width);
+	size_t elements = 1;
+	for (int i = 0; i <= depth; i++)
+	{
+		elements *= width;
+	}
+
+	RunTimed("YAML HashReflected", elements, REPEAT_COUNT, [&]()
+	{
+		auto str = tako::Serialization::YAML::Serialize(root);
+		sum += tako::Hash::HashStr(str);
+	});
+
+	RunTimed("Structural HashReflected", elements, REPEAT_COUNT, [&]()
+	{
+		sum += tako::Hash::HashReflected(root);
+	});
+}
+
+int main()
+{
+	size_t sum = 0;
+	RunTree(0, 4, sum);
+	RunTree(1, 8, sum);
+	RunTree(2, 8, sum);
+	RunTree(3, 8, sum);
+	LOG("{}", sum);
+}
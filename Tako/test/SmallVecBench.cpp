@@ -0,0 +1,85 @@
+#define TAKO_FORCE_LOG
+#include "Utility.hpp"
+#include "BenchUtil.hpp"
+#include <chrono>
+#include <vector>
+#include <span>
+
+import Tako.SmallVec;
+
+constexpr auto REPEAT_COUNT = 100;
+constexpr auto CONTAINER_COUNT = 100000;
+
+template<typename Vec>
+Vec Fill(size_t elements)
+{
+	Vec vec;
+	for (size_t i = 0; i < elements; i++)
+	{
+		vec.push_back(int(i));
+	}
+	return vec;
+}
+
+template<typename Vec>
+int Sum(const Vec& vec)
+{
+	int sum = 0;
+	for (auto v : vec)
+	{
+		sum += v;
+	}
+	return sum;
+}
+
+// Build and return small lists, the typical use of both containers
+template<size_t N>
+void RunSize(int& sum)
+{
+	RunTimed("std::vector Fill", N, REPEAT_COUNT, [&]()
+	{
+		for (int i = 0; i < CONTAINER_COUNT; i++)
+		{
+			sum += Sum(Fill<std::vector<int>>(N));
+		}
+	});
+
+	RunTimed("SmallVec Fill", N, REPEAT_COUNT, [&]()
+	{
+		for (int i = 0; i < CONTAINER_COUNT; i++)
+		{
+			sum += Sum(Fill<tako::SmallVec<int, 16>>(N));
+		}
+	});
+
+	std::vector<int> source = Fill<std::vector<int>>(N);
+	RunTimed("std::vector Append", N, REPEAT_COUNT, [&]()
+	{
+		for (int i = 0; i < CONTAINER_COUNT; i++)
+		{
+			std::vector<int> vec;
+			vec.insert(vec.end(), source.begin(), source.end());
+			sum += Sum(vec);
+		}
+	});
+
+	RunTimed("SmallVec Append", N, REPEAT_COUNT, [&]()
+	{
+		for (int i = 0; i < CONTAINER_COUNT; i++)
+		{
+			tako::SmallVec<int, 16> vec;
+			vec.Append(source);
+			sum += Sum(vec);
+		}
+	});
+}
+
+int main()
+{
+	int sum = 0;
+	RunSize<4>(sum);
+	RunSize<8>(sum);
+	RunSize<16>(sum);
+	RunSize<64>(sum);
+	LOG("{}", sum);
+}
@@ -0,0 +1,162 @@
+#define TAKO_FORCE_LOG
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_STATIC
+#include "Utility.hpp"
+#include "stb_image_write.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+import Tako.NumberTypes;
+import Tako.IO;
+import Tako.Pack;
+
+using namespace tako;
+
+// Packs a directory into a single archive the VFS can mount with AddMountArchive
+// Usage: PackBuilder <AssetsDir> <output.pak> [--compress]
+
+struct PackFile
+{
+	std::string path;
+	std::vector<U8> data;
+	PackEntry entry;
+};
+
+size_t AlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool LoadFile(const std::filesystem::path& path, std::vector<U8>& target)
+{
+	auto file = IO::Map(path.string());
+	if (!file.IsValid())
+	{
+		return false;
+	}
+	target.assign(file.GetData(), file.GetData() + file.GetSize());
+	return true;
+}
+
+// Zlib only pays off for data that isn't compressed already, so it's kept only when it saves more than 10%
+void Compress(PackFile& file)
+{
+	int compressedSize = 0;
+	U8* compressed = stbi_zlib_compress(file.data.data(), static_cast<int>(file.data.size()), &compressedSize, 8);
+	if (compressed && static_cast<size_t>(compressedSize) * 10 < file.data.size() * 9)
+	{
+		file.data.assign(compressed, compressed + compressedSize);
+		file.entry.compression = PackCompression::Zlib;
+	}
+	STBIW_FREE(compressed);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		LOG_ERR("Usage: PackBuilder <AssetsDir> <output.pak> [--compress]");
+		return 1;
+	}
+	std::filesystem::path root(argv[1]);
+	std::string_view outputPath(argv[2]);
+	bool compress = argc > 3 && std::string_view(argv[3]) == "--compress";
+
+	std::vector<std::filesystem::path> sources;
+	for (auto& dirEntry : std::filesystem::recursive_directory_iterator(root))
+	{
+		if (dirEntry.is_regular_file())
+		{
+			sources.push_back(dirEntry.path());
+		}
+	}
+	// Sorted so the same input always produces the same pack
+	std::sort(sources.begin(), sources.end());
+
+	std::vector<PackFile> files;
+	files.reserve(sources.size());
+	for (auto& source : sources)
+	{
+		PackFile file;
+		file.path = "/" + std::filesystem::relative(source, root).generic_string();
+		if (!LoadFile(source, file.data))
+		{
+			LOG_ERR("Could not read {}", source.string());
+			return 1;
+		}
+		file.entry = {};
+		file.entry.pathHash = HashPackPath(file.path);
+		file.entry.size = file.data.size();
+		file.entry.compression = PackCompression::None;
+		if (compress && !file.data.empty())
+		{
+			Compress(file);
+		}
+		file.entry.storedSize = file.data.size();
+		files.push_back(std::move(file));
+	}
+
+	std::sort(files.begin(), files.end(), [](const PackFile& a, const PackFile& b)
+	{
+		return a.entry.pathHash < b.entry.pathHash;
+	});
+
+	PackHeader header = {};
+	header.magic = PackMagic;
+	header.version = PackVersion;
+	header.entryCount = static_cast<U32>(files.size());
+	header.indexOffset = sizeof(PackHeader);
+	header.pathsOffset = header.indexOffset + files.size() * sizeof(PackEntry);
+
+	std::string paths;
+	for (auto& file : files)
+	{
+		file.entry.pathOffset = static_cast<U32>(paths.size());
+		file.entry.pathLength = static_cast<U32>(file.path.size());
+		paths += file.path;
+	}
+
+	size_t offset = header.pathsOffset + paths.size();
+	for (auto& file : files)
+	{
+		offset = AlignUp(offset, PackAlignment);
+		file.entry.offset = offset;
+		offset += file.entry.storedSize;
+	}
+
+	auto output = IO::Open(outputPath, IO::FileOpenMode::Write);
+	if (!output)
+	{
+		LOG_ERR("Could not open {} for writing", outputPath);
+		return 1;
+	}
+	size_t written = IO::Write(output, reinterpret_cast<const U8*>(&header), sizeof(header));
+	for (auto& file : files)
+	{
+		written += IO::Write(output, reinterpret_cast<const U8*>(&file.entry), sizeof(PackEntry));
+	}
+	written += IO::Write(output, reinterpret_cast<const U8*>(paths.data()), paths.size());
+	U8 padding[PackAlignment] = {};
+	for (auto& file : files)
+	{
+		written += IO::Write(output, padding, file.entry.offset - written);
+		if (!file.data.empty())
+		{
+			written += IO::Write(output, file.data.data(), file.data.size());
+		}
+	}
+	IO::Close(output);
+
+	if (written != offset)
+	{
+		LOG_ERR("Could not write {}", outputPath);
+		return 1;
+	}
+	LOG("Packed {} files into {} ({} bytes)", files.size(), outputPath, written);
+	return 0;
+}